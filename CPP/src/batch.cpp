@@ -0,0 +1,124 @@
+#include "batch.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+#include "thread_pool.h"
+
+using namespace std;
+namespace fs = std::filesystem;
+
+bool list_batch_inputs(const string& source, vector<string>& paths, string& error) {
+    error_code ec;
+    if (fs::is_directory(source, ec)) {
+        for (const auto& entry : fs::directory_iterator(source, ec)) {
+            string name = entry.path().filename().string();
+            if (entry.is_regular_file() && name[0] != '.') {
+                paths.push_back(entry.path().string());
+            }
+        }
+        if (ec) {
+            error = "Cannot read directory " + source;
+            return false;
+        }
+        sort(paths.begin(), paths.end());
+        return true;
+    }
+
+    ifstream manifest(source);
+    if (!manifest) {
+        error = "Cannot open " + source;
+        return false;
+    }
+    fs::path base = fs::path(source).parent_path();
+    string line;
+    while (getline(manifest, line)) {
+        while (!line.empty() && (line.back() == '\r' || line.back() == ' ' || line.back() == '\t')) {
+            line.pop_back();
+        }
+        size_t start = line.find_first_not_of(" \t");
+        if (start == string::npos || line[start] == '#') {
+            continue;
+        }
+        fs::path p = line.substr(start);
+        paths.push_back(p.is_absolute() ? p.string() : (base / p).string());
+    }
+    return true;
+}
+
+vector<BatchResult> run_batch(const vector<string>& paths, unsigned jobs,
+                              const function<void(BatchResult&)>& simulate) {
+    vector<BatchResult> results(paths.size());
+    ThreadPool pool(jobs);
+    for (size_t k = 0; k < paths.size(); ++k) {
+        results[k].path = paths[k];
+        BatchResult* slot = &results[k];
+        pool.submit([slot, &simulate] { simulate(*slot); });
+    }
+    pool.wait();
+    return results;
+}
+
+void write_json_string(ostream& out, const string& text) {
+    out << '"';
+    for (unsigned char c : text) {
+        if (c == '"' || c == '\\') {
+            out << '\\' << c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            out << escaped;
+        } else {
+            out << c;
+        }
+    }
+    out << '"';
+}
+
+static void write_results(ostream& out, const vector<BatchResult>& results) {
+    PerfCounters total;
+    size_t failed = 0;
+
+    out << "{\"traces\": [\n";
+    for (size_t k = 0; k < results.size(); ++k) {
+        const BatchResult& r = results[k];
+        out << "  {\"trace\": ";
+        write_json_string(out, r.path);
+        if (r.ok) {
+            out << ", ";
+            write_counters_fields(out, r.counters);
+            total.add(r.counters);
+        } else {
+            out << ", \"error\": ";
+            write_json_string(out, r.error);
+            failed += 1;
+        }
+        out << (k + 1 < results.size() ? "},\n" : "}\n");
+    }
+    out << "], \"failed\": " << failed << ", \"total\": {";
+    write_counters_fields(out, total);
+    out << "}}\n";
+    out.flush();
+}
+
+bool write_batch_results(const string& path, const vector<BatchResult>& results) {
+    if (path == "-") {
+        write_results(cout, results);
+    } else {
+        ofstream out(path);
+        if (!out) {
+            cerr << "Cannot write " << path << endl;
+            return false;
+        }
+        write_results(out, results);
+    }
+    for (const auto& r : results) {
+        if (!r.ok) {
+            cerr << r.path << ": " << r.error << endl;
+        }
+    }
+    return true;
+}
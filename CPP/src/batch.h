@@ -0,0 +1,40 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <functional>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "counters.h"
+
+// Outcome of simulating one trace in a batch
+struct BatchResult {
+    std::string path;
+    bool ok = false;
+    std::string error;
+    PerfCounters counters;
+};
+
+// Expand a batch source into trace paths. A directory gives every regular
+// file in it, in name order; any other file is read as a manifest with
+// one path per line (blank lines and lines starting with # are ignored,
+// relative paths are taken from the manifest's directory).
+bool list_batch_inputs(const std::string& source, std::vector<std::string>& paths, std::string& error);
+
+// Most threads --jobs accepts
+const unsigned MAX_JOBS = 1024;
+
+// Call simulate() for each path on a pool of jobs threads (0: one per
+// core). Results come back in the order of paths.
+std::vector<BatchResult> run_batch(const std::vector<std::string>& paths, unsigned jobs,
+                                   const std::function<void(BatchResult&)>& simulate);
+
+// Write text as a quoted JSON string
+void write_json_string(std::ostream& out, const std::string& text);
+
+// Write every result and their totals as one JSON document to path ("-"
+// for stdout).
+bool write_batch_results(const std::string& path, const std::vector<BatchResult>& results);
+
+#endif
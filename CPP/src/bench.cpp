@@ -0,0 +1,443 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+
+using namespace std;
+
+// Throughput of the simulator itself, in simulated instructions per
+// second, measured separately for each part of a run:
+//
+//   load       read a hex trace and decode it (Program::load)
+//   decode     predecode() into records, predecode_columns() into
+//              columns (decode-columns) and decode_word() one word at a
+//              time (decode-scalar), over words already in memory
+//   simulate   the pipeline with hazard checks, counters only, for each
+//              hazard policy (the kernels are executed, --execute style)
+//   render     render_table() of a finished timeline to /dev/null, in
+//              the run-length and grid formats
+//
+// over synthetic traces of increasing size and dependency density and the
+// bundled strlen/strncpy/stringcopy kernels.
+//
+//   bench [--filter text] [--repeat n] [--min-time ms] [--json file]
+//         [--kernels dir]
+//
+// Each benchmark is timed in batches of at least min-time and the fastest
+// of repeat batches is reported, which keeps the numbers steady enough to
+// compare between builds. Before anything is timed, both bulk decoders
+// are checked against decode_word().
+
+struct BenchCase {
+    string name;
+    string path;                   // hex trace on disk
+    shared_ptr<const Program> program;
+    SimConfig config;              // for simulate
+    size_t dynamic_instructions = 0;
+};
+
+struct BenchResult {
+    string benchmark;
+    string trace;
+    size_t instructions = 0;
+    double seconds = 0;            // per iteration, best batch
+
+    double rate() const { return seconds > 0 ? instructions / seconds : 0.0; }
+};
+
+struct BenchOptions {
+    string filter;
+    int repeat = 5;
+    double min_time = 0.05;
+    string json_path;
+    string kernel_dir = "../inputfiles";
+};
+
+// Run body until min_time has passed, repeat times, and return the best
+// time per call
+template <class Body>
+static double time_best(const BenchOptions& options, Body body) {
+    typedef chrono::steady_clock Clock;
+    double best = 0;
+    for (int r = 0; r < options.repeat; ++r) {
+        size_t calls = 0;
+        Clock::time_point start = Clock::now();
+        double elapsed = 0;
+        do {
+            body();
+            calls += 1;
+            elapsed = chrono::duration<double>(Clock::now() - start).count();
+        } while (elapsed < options.min_time);
+        double per_call = elapsed / calls;
+        if (r == 0 || per_call < best) {
+            best = per_call;
+        }
+    }
+    return best;
+}
+
+// Deterministic generator, so every build sees the same traces
+struct Lcg {
+    uint64_t state;
+    explicit Lcg(uint64_t seed) : state(seed) {}
+    uint32_t next() {
+        state = state * 6364136223846793005ull + 1442695040888963407ull;
+        return (uint32_t)(state >> 33);
+    }
+    bool chance(int percent) { return (int)(next() % 100) < percent; }
+};
+
+static uint32_t r_type(int rd, int rs1, int rs2) {
+    return (rs2 << 20) | (rs1 << 15) | (rd << 7) | 0x33;
+}
+
+static uint32_t i_type(uint32_t opcode, int funct3, int rd, int rs1, int imm) {
+    return ((uint32_t)(imm & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static uint32_t s_type(int rs1, int rs2, int imm) {
+    return ((uint32_t)((imm >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | (2 << 12) | ((imm & 0x1f) << 7) | 0x23;
+}
+
+// beq rs1, rs2, +8 (never taken in a listing, which is not executed)
+static uint32_t b_type(int rs1, int rs2) {
+    return (rs2 << 20) | (rs1 << 15) | (4 << 8) | 0x63;
+}
+
+// A mix of ALU ops, loads, stores and branches. With probability
+// density% an instruction reads the result of the one before it;
+// otherwise its sources are registers nothing in the trace writes.
+static vector<uint32_t> synthetic_trace(size_t count, int density) {
+    Lcg rng(count * 101 + density);
+    vector<uint32_t> words;
+    words.reserve(count);
+    int last_rd = 0;
+    for (size_t i = 0; i < count; ++i) {
+        int rd = 5 + (int)(i % 11);                // x5..x15
+        int other = 16 + (int)(rng.next() % 8);    // x16..x23, never written
+        int source = last_rd != 0 && rng.chance(density) ? last_rd : other;
+        int kind = rng.next() % 20;
+        if (kind < 8) {
+            words.push_back(r_type(rd, source, other));
+        } else if (kind < 13) {
+            words.push_back(i_type(0x13, 0, rd, source, (int)(rng.next() % 64)));
+        } else if (kind < 16) {
+            words.push_back(i_type(0x03, 2, rd, source, 4 * (int)(rng.next() % 16)));
+        } else if (kind < 18) {
+            words.push_back(s_type(other, source, 4 * (int)(rng.next() % 16)));
+            rd = 0;
+        } else {
+            words.push_back(b_type(source, other));
+            rd = 0;
+        }
+        last_rd = rd;
+    }
+    return words;
+}
+
+static bool load_case(BenchCase& c, string& error) {
+    shared_ptr<Program> loaded(new Program);
+    if (!loaded->load(c.path, error)) {
+        return false;
+    }
+    c.program = loaded;
+    return true;
+}
+
+// Count what a simulate iteration covers, so the rate is per simulated
+// instruction even when the kernels loop
+static size_t count_instructions(const BenchCase& c) {
+    unique_ptr<Simulation> sim(new Simulation(c.config));
+    run_with_policy(*sim, PolicyKind::FORWARDING, c.program);
+    return sim->counters().instructions;
+}
+
+static bool make_cases(const BenchOptions& options, const string& dir, vector<BenchCase>& cases) {
+    string error;
+    const size_t sizes[] = {1000, 16000, 256000};
+    const int densities[] = {0, 50, 100};
+    for (size_t size : sizes) {
+        for (int density : densities) {
+            BenchCase c;
+            c.name = "synthetic-" + to_string(size / 1000) + "k-dep" + to_string(density);
+            c.path = dir + "/" + c.name + ".txt";
+            vector<uint32_t> words = synthetic_trace(size, density);
+            if (!write_text_trace(c.path, words.data(), words.size()) || !load_case(c, error)) {
+                cerr << "Cannot create " << c.path << " " << error << endl;
+                return false;
+            }
+            cases.push_back(move(c));
+        }
+    }
+
+    // The kernels walk a 4000-character string
+    string text(4000, 'x');
+    const char* kernels[] = {"strlen", "strncpy", "stringcopy"};
+    for (const char* name : kernels) {
+        BenchCase c;
+        c.name = name;
+        c.path = options.kernel_dir + "/" + name + ".txt";
+        if (!load_case(c, error)) {
+            cerr << error << endl;
+            return false;
+        }
+        c.config.execute = true;
+        c.config.register_args = {"a0=0x30000", "a1=0x20000", "a2=4000"};
+        c.config.string_args = {"0x20000=" + text};
+        if (c.name == "strlen") {
+            c.config.register_args = {"a0=0x20000"};
+        }
+        cases.push_back(move(c));
+    }
+
+    for (auto& c : cases) {
+        c.config.mode = OUTPUT_NONE;
+        c.dynamic_instructions = count_instructions(c);
+    }
+    return true;
+}
+
+// Timeline for the render benchmark: the forwarding pipeline's shape,
+// with a one-cycle bubble after each load whose result is used next
+static void fill_timeline(const Program& program, Timeline& timeline) {
+    timeline.resize(program.size());
+    int fetch = 1;
+    const InstructionInfo* prev = nullptr;
+    for (size_t i = 0; i < program.size(); ++i) {
+        const InstructionInfo& inst = program.insts[i];
+        int bubble = prev && prev->type == OpClass::LOAD && prev->rd != 0 &&
+                     ((reads_rs1(inst) && inst.rs1 == prev->rd) || (reads_rs2(inst) && inst.rs2 == prev->rd));
+        for (int s = 0; s < NUM_STAGES; ++s) {
+            timeline.enter(i, (Stage)s, fetch + s + (s >= STAGE_EXE ? bubble : 0));
+        }
+        fetch += 1 + bubble;
+        prev = &inst;
+    }
+}
+
+static bool same_decode(const InstructionInfo& a, const InstructionInfo& b) {
+    return a.type == b.type && a.rd == b.rd && a.rs1 == b.rs1 && a.rs2 == b.rs2 && a.funct3 == b.funct3 &&
+           a.funct7 == b.funct7 && a.size == b.size && a.imm == b.imm;
+}
+
+// predecode() and predecode_columns() must give what decode_word() does
+// for every word
+static bool check_predecode(const string& name, const uint32_t* words, size_t n) {
+    vector<InstructionInfo> records = predecode(words, n);
+    DecodedColumns columns;
+    predecode_columns(words, n, columns);
+    for (size_t i = 0; i < n; ++i) {
+        InstructionInfo expected = decode_word(words[i]);
+        const char* which = !same_decode(records[i], expected)      ? "predecode"
+                            : !same_decode(columns.row(i), expected) ? "predecode_columns"
+                                                                     : nullptr;
+        if (which) {
+            char word[9];
+            snprintf(word, sizeof(word), "%08x", words[i]);
+            cerr << which << " (" << predecode_isa() << ") differs from decode_word on " << name << " row " << i
+                 << ": " << word << endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+// Random words, half of them only 16 bits (mostly compressed), and an odd
+// count so the kernels leave a tail
+static bool check_predecode_random() {
+    vector<uint32_t> words(100003);
+    uint32_t state = 0x2545f491;
+    for (auto& word : words) {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+        word = state & 0x80000000 ? state | 3 : state & 0xffff;
+    }
+    return check_predecode("random words", words.data(), words.size());
+}
+
+static bool selected(const BenchOptions& options, const string& benchmark, const string& trace) {
+    return options.filter.empty() || (benchmark + "/" + trace).find(options.filter) != string::npos;
+}
+
+static void run_benchmarks(const BenchOptions& options, const vector<BenchCase>& cases,
+                           vector<BenchResult>& results) {
+    auto record = [&results](const string& benchmark, const string& trace, size_t n, double seconds) {
+        BenchResult r;
+        r.benchmark = benchmark;
+        r.trace = trace;
+        r.instructions = n;
+        r.seconds = seconds;
+        results.push_back(r);
+    };
+
+    for (const auto& c : cases) {
+        if (selected(options, "load", c.name)) {
+            double t = time_best(options, [&c] {
+                Program p;
+                string error;
+                p.load(c.path, error);
+            });
+            record("load", c.name, c.program->size(), t);
+        }
+        if (selected(options, "decode", c.name)) {
+            const uint32_t* words = c.program->words();
+            size_t n = c.program->size();
+            volatile uint32_t sink = 0;
+            double t = time_best(options, [words, n, &sink] {
+                sink = sink + (uint32_t)predecode(words, n).size();
+            });
+            record("decode", c.name, n, t);
+        }
+        if (selected(options, "decode-columns", c.name)) {
+            const uint32_t* words = c.program->words();
+            size_t n = c.program->size();
+            volatile uint32_t sink = 0;
+            DecodedColumns columns;
+            double t = time_best(options, [words, n, &sink, &columns] {
+                predecode_columns(words, n, columns);
+                sink = sink + (uint32_t)columns.count();
+            });
+            record("decode-columns", c.name, n, t);
+        }
+        if (selected(options, "decode-scalar", c.name)) {
+            const uint32_t* words = c.program->words();
+            size_t n = c.program->size();
+            volatile uint32_t sink = 0;
+            double t = time_best(options, [words, n, &sink] {
+                uint32_t sum = 0;
+                for (size_t i = 0; i < n; ++i) {
+                    InstructionInfo inst = decode_word(words[i]);
+                    sum += inst.rd + (uint32_t)inst.type;
+                }
+                sink = sink + sum;
+            });
+            record("decode-scalar", c.name, n, t);
+        }
+        const PolicyKind policies[] = {PolicyKind::FORWARDING, PolicyKind::NONE};
+        for (PolicyKind policy : policies) {
+            string benchmark = string("simulate-") + policy_kind_name(policy);
+            if (!selected(options, benchmark, c.name)) continue;
+            double t = time_best(options, [&c, policy] {
+                unique_ptr<Simulation> sim(new Simulation(c.config));
+                run_with_policy(*sim, policy, c.program);
+            });
+            record(benchmark, c.name, c.dynamic_instructions, t);
+        }
+        // Rendering works on the static listing, which for the kernels is a
+        // handful of lines. The grid is rows x cycles, so only the smallest
+        // traces are rendered as one.
+        if (c.config.execute) continue;
+        const TableFormat formats[] = {TableFormat::RLE, TableFormat::GRID};
+        const char* format_names[] = {"render-rle", "render-grid"};
+        for (int f = 0; f < 2; ++f) {
+            if (!selected(options, format_names[f], c.name) ||
+                (formats[f] == TableFormat::GRID && c.program->size() > 1000)) {
+                continue;
+            }
+            Timeline timeline;
+            fill_timeline(*c.program, timeline);
+            RenderOptions render;
+            render.format = formats[f];
+            FILE* null_out = fopen("/dev/null", "w");
+            if (!null_out) continue;
+            double t = time_best(options, [&] {
+                render_table(timeline, c.program->words(), c.program->size(), timeline.total_cycles(), render,
+                             null_out);
+            });
+            fclose(null_out);
+            record(format_names[f], c.name, c.program->size(), t);
+        }
+    }
+}
+
+static void print_results(const vector<BenchResult>& results) {
+    cout << left << setw(22) << "Benchmark" << setw(24) << "Trace" << right << setw(12) << "Instructions"
+         << setw(12) << "Time (us)" << setw(12) << "M inst/s" << "\n";
+    for (const auto& r : results) {
+        cout << left << setw(22) << r.benchmark << setw(24) << r.trace << right << setw(12) << r.instructions
+             << setw(12) << fixed << setprecision(1) << r.seconds * 1e6 << setw(12) << setprecision(2)
+             << r.rate() / 1e6 << "\n";
+    }
+    cout.flush();
+}
+
+static bool write_json(const string& path, const vector<BenchResult>& results) {
+    ofstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            cerr << "Cannot write " << path << endl;
+            return false;
+        }
+    }
+    ostream& out = path == "-" ? cout : file;
+    out << "[\n";
+    for (size_t k = 0; k < results.size(); ++k) {
+        const BenchResult& r = results[k];
+        out << "  {\"benchmark\": \"" << r.benchmark << "\", \"trace\": \"" << r.trace
+            << "\", \"instructions\": " << r.instructions << ", \"seconds\": " << scientific
+            << setprecision(6) << r.seconds << ", \"instructions_per_second\": " << fixed << setprecision(0)
+            << r.rate() << (k + 1 < results.size() ? "},\n" : "}\n");
+    }
+    out << "]\n";
+    out.flush();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        if (arg == "--filter" && has_value) {
+            options.filter = argv[++a];
+        } else if (arg == "--repeat" && has_value) {
+            options.repeat = max(1, atoi(argv[++a]));
+        } else if (arg == "--min-time" && has_value) {
+            options.min_time = atof(argv[++a]) / 1000.0;
+        } else if (arg == "--json" && has_value) {
+            options.json_path = argv[++a];
+        } else if (arg == "--kernels" && has_value) {
+            options.kernel_dir = argv[++a];
+        } else {
+            cerr << "Usage: bench [--filter text] [--repeat n] [--min-time ms] [--json file] [--kernels dir]"
+                 << endl;
+            return 1;
+        }
+    }
+
+    char dir_template[] = "/tmp/pipeline-bench-XXXXXX";
+    if (!mkdtemp(dir_template)) {
+        cerr << "Cannot create a temporary directory" << endl;
+        return 1;
+    }
+    string dir = dir_template;
+
+    vector<BenchCase> cases;
+    vector<BenchResult> results;
+    bool ok = make_cases(options, dir, cases) && check_predecode_random();
+    for (size_t k = 0; ok && k < cases.size(); ++k) {
+        ok = check_predecode(cases[k].name, cases[k].program->words(), cases[k].program->size());
+    }
+    if (ok) {
+        run_benchmarks(options, cases, results);
+        print_results(results);
+        ok = options.json_path.empty() || write_json(options.json_path, results);
+    }
+    for (const auto& c : cases) {
+        if (c.path.compare(0, dir.size(), dir) == 0) {
+            remove(c.path.c_str());
+        }
+    }
+    remove(dir.c_str());
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,200 @@
+#include "cache.h"
+
+#include <cstdlib>
+#include <istream>
+#include <ostream>
+
+#include "serialize.h"
+
+using namespace std;
+
+static const uint32_t INVALID_LINE = ~0u;
+
+static bool is_power_of_two(uint32_t n) {
+    return n != 0 && (n & (n - 1)) == 0;
+}
+
+static unsigned log2_of(uint32_t n) {
+    unsigned bits = 0;
+    while ((1u << bits) < n) {
+        bits += 1;
+    }
+    return bits;
+}
+
+static bool parse_size(const string& text, uint32_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    if (text[0] < '0' || text[0] > '9') {
+        return false;
+    }
+    char* end;
+    unsigned long long n = strtoull(text.c_str(), &end, 10);
+    if (*end == 'k' || *end == 'K') {
+        n = n > MAX_CACHE_SIZE ? n : n * 1024;
+        end += 1;
+    }
+    if (*end != '\0' || n > MAX_CACHE_SIZE) {
+        return false;
+    }
+    value = (uint32_t)n;
+    return true;
+}
+
+bool parse_cache_config(const string& text, CacheConfig& config) {
+    vector<string> fields;
+    size_t start = 0;
+    while (true) {
+        size_t colon = text.find(':', start);
+        fields.push_back(text.substr(start, colon - start));
+        if (colon == string::npos) break;
+        start = colon + 1;
+    }
+    if (fields.size() < 3 || fields.size() > 4) {
+        return false;
+    }
+
+    CacheConfig c;
+    uint32_t assoc, line;
+    if (!parse_size(fields[0], c.size) || !parse_size(fields[1], assoc) || !parse_size(fields[2], line)) {
+        return false;
+    }
+    c.assoc = assoc;
+    c.line_size = line;
+    if (fields.size() == 4) {
+        if (fields[3] == "lru") c.replacement = Replacement::LRU;
+        else if (fields[3] == "plru") c.replacement = Replacement::PLRU;
+        else return false;
+    }
+    if (!c.enabled() || !c.valid()) {
+        return false;
+    }
+    config = c;
+    return true;
+}
+
+bool CacheConfig::valid() const {
+    if (!enabled()) {
+        return true;
+    }
+    // 64-bit, so a huge line size cannot wrap the product to zero
+    return is_power_of_two(size) && is_power_of_two(assoc) && is_power_of_two(line_size) &&
+           size <= MAX_CACHE_SIZE && line_size >= 4 && assoc <= 64 &&
+           (uint64_t)assoc * line_size <= size;
+}
+
+void Cache::save(ostream& out) const {
+    put_pod(out, ways);
+    put_pod(out, line_bits);
+    put_pod(out, set_mask);
+    put_pod(out, replacement);
+    put_vector(out, tags);
+    put_vector(out, stamps);
+    put_vector(out, trees);
+    put_pod(out, clock);
+    put_pod(out, hits);
+    put_pod(out, misses);
+}
+
+bool Cache::load(istream& in) {
+    unsigned saved_ways, saved_line_bits;
+    uint32_t saved_mask;
+    Replacement saved_replacement;
+    if (!get_pod(in, saved_ways) || !get_pod(in, saved_line_bits) || !get_pod(in, saved_mask) ||
+        !get_pod(in, saved_replacement)) {
+        return false;
+    }
+    if (saved_ways != ways || saved_line_bits != line_bits || saved_mask != set_mask ||
+        saved_replacement != replacement) {
+        return false;
+    }
+    return get_sized_vector(in, tags) && get_sized_vector(in, stamps) && get_sized_vector(in, trees) &&
+           get_pod(in, clock) && get_pod(in, hits) && get_pod(in, misses);
+}
+
+Cache::Cache(const CacheConfig& config) {
+    if (!config.enabled() || !config.valid()) {
+        return;
+    }
+    ways = config.assoc;
+    line_bits = log2_of(config.line_size);
+    unsigned sets = config.size / (config.assoc * config.line_size);
+    set_mask = sets - 1;
+    replacement = config.replacement;
+    tags.assign(sets * ways, INVALID_LINE);
+    if (replacement == Replacement::LRU) {
+        stamps.assign(sets * ways, 0);
+    } else {
+        trees.assign(sets, 0);
+    }
+}
+
+bool Cache::access(uint32_t addr) {
+    uint32_t line = addr >> line_bits;
+    unsigned set = line & set_mask;
+    uint32_t* row = &tags[set * ways];
+
+    for (unsigned w = 0; w < ways; ++w) {
+        if (row[w] == line) {
+            hits += 1;
+            touch(set, w);
+            return true;
+        }
+    }
+
+    misses += 1;
+    unsigned victim = find_victim(set);
+    row[victim] = line;
+    touch(set, victim);
+    return false;
+}
+
+unsigned Cache::find_victim(unsigned set) const {
+    const uint32_t* row = &tags[set * ways];
+    for (unsigned w = 0; w < ways; ++w) {
+        if (row[w] == INVALID_LINE) {
+            return w;
+        }
+    }
+
+    if (replacement == Replacement::LRU) {
+        const uint32_t* stamp = &stamps[set * ways];
+        unsigned oldest = 0;
+        for (unsigned w = 1; w < ways; ++w) {
+            // Differences handle the clock wrapping around
+            if (clock - stamp[w] > clock - stamp[oldest]) {
+                oldest = w;
+            }
+        }
+        return oldest;
+    }
+
+    // Follow the tree bits from the root; node n has children 2n and 2n+1
+    uint64_t tree = trees[set];
+    unsigned node = 1;
+    while (node < ways) {
+        node = node * 2 + ((tree >> node) & 1);
+    }
+    return node - ways;
+}
+
+void Cache::touch(unsigned set, unsigned way) {
+    if (replacement == Replacement::LRU) {
+        stamps[set * ways + way] = ++clock;
+        return;
+    }
+
+    // Point every node on the path away from the way just used
+    uint64_t& tree = trees[set];
+    unsigned node = way + ways;
+    while (node > 1) {
+        unsigned parent = node / 2;
+        if (node & 1) {
+            tree &= ~(1ull << parent);
+        } else {
+            tree |= 1ull << parent;
+        }
+        node = parent;
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+enum class Replacement : uint8_t {
+    LRU,
+    PLRU   // tree pseudo-LRU
+};
+
+struct CacheConfig {
+    uint32_t size = 0;        // bytes; 0 disables the cache
+    unsigned assoc = 1;
+    unsigned line_size = 32;  // bytes
+    Replacement replacement = Replacement::LRU;
+
+    bool enabled() const { return size > 0; }
+    // Powers of two, at least one set, and no bigger than MAX_CACHE_SIZE
+    // (a disabled cache is always valid)
+    bool valid() const;
+};
+
+// Largest cache accepted, in bytes
+const uint32_t MAX_CACHE_SIZE = 1u << 26;
+
+// Parse "size:assoc:line[:lru|plru]", e.g. "4096:2:32:plru". Sizes may use
+// a k suffix. Everything must be a power of two.
+bool parse_cache_config(const std::string& text, CacheConfig& config);
+
+// Set-associative tag store. Only tags are modelled: stores allocate like
+// loads, and write-backs of dirty lines are not charged.
+class Cache {
+public:
+    Cache() {}
+    explicit Cache(const CacheConfig& config);
+
+    bool enabled() const { return !tags.empty(); }
+
+    // Look up addr and fill its line on a miss. Returns true on a hit.
+    bool access(uint32_t addr);
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+
+    // Checkpoint support. load() fails if the checkpoint was taken with a
+    // different geometry.
+    void save(std::ostream& out) const;
+    bool load(std::istream& in);
+
+private:
+    unsigned find_victim(unsigned set) const;
+    void touch(unsigned set, unsigned way);
+
+    unsigned ways = 0;
+    unsigned line_bits = 0;
+    uint32_t set_mask = 0;
+    Replacement replacement = Replacement::LRU;
+    // Line addresses, one row of `ways` entries per set so a lookup only
+    // touches a single contiguous run. INVALID_LINE marks an empty way.
+    std::vector<uint32_t> tags;
+    std::vector<uint32_t> stamps;   // LRU: last use, per way
+    std::vector<uint64_t> trees;    // PLRU: one bit tree per set
+    uint32_t clock = 0;
+};
+
+#endif
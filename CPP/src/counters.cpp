@@ -0,0 +1,137 @@
+#include "counters.h"
+
+#include <iomanip>
+
+using namespace std;
+
+static const char* const json_cause_names[NUM_STALL_CAUSES] = {
+    "raw", "load_use", "structural", "icache", "dcache", "load_latency", "execute", "commit"
+};
+
+const char* stall_cause_name(StallCause cause) {
+    switch (cause) {
+        case STALL_RAW: return "RAW";
+        case STALL_LOAD_USE: return "Load-use";
+        case STALL_STRUCTURAL: return "Structural";
+        case STALL_ICACHE: return "I-cache miss";
+        case STALL_DCACHE: return "D-cache miss";
+        case STALL_LOAD_LATENCY: return "Load latency";
+        case STALL_EXECUTE: return "Execute latency";
+        default: return "Commit";
+    }
+}
+
+void PerfCounters::add(const PerfCounters& other) {
+    instructions += other.instructions;
+    squashed += other.squashed;
+    cycles += other.cycles;
+    stall_cycles += other.stall_cycles;
+    for (int s = 0; s < NUM_STALL_CAUSES; ++s) {
+        stalls[s] += other.stalls[s];
+    }
+    for (int r = 0; r < NUM_INT_REGS; ++r) {
+        data_stalls_by_register[r] += other.data_stalls_by_register[r];
+    }
+    control_cycles += other.control_cycles;
+    for (int k = 0; k < NUM_OP_CLASSES; ++k) {
+        by_class[k] += other.by_class[k];
+    }
+}
+
+void PerfCounters::subtract(const PerfCounters& other) {
+    instructions -= other.instructions;
+    squashed -= other.squashed;
+    cycles -= other.cycles;
+    stall_cycles -= other.stall_cycles;
+    for (int s = 0; s < NUM_STALL_CAUSES; ++s) {
+        stalls[s] -= other.stalls[s];
+    }
+    for (int r = 0; r < NUM_INT_REGS; ++r) {
+        data_stalls_by_register[r] -= other.data_stalls_by_register[r];
+    }
+    control_cycles -= other.control_cycles;
+    for (int k = 0; k < NUM_OP_CLASSES; ++k) {
+        by_class[k] -= other.by_class[k];
+    }
+}
+
+void print_counters(ostream& out, const PerfCounters& c) {
+    out << "Instructions: " << c.instructions << "\n";
+    out << "Cycles: " << c.cycles << "\n";
+    out << "Stall cycles: " << c.stall_cycles << "\n";
+    if (c.squashed > 0) {
+        out << "Squashed: " << c.squashed << "\n";
+    }
+    if (c.instructions > 0) {
+        SavedFormat saved(out);
+        out << "CPI: " << fixed << setprecision(3) << c.cpi() << "\n";
+    }
+
+    for (int s = 0; s < NUM_STALL_CAUSES; ++s) {
+        if (c.stalls[s] > 0) {
+            out << "  " << stall_cause_name((StallCause)s) << ": " << c.stalls[s] << "\n";
+        }
+    }
+    if (c.control_cycles > 0) {
+        out << "Control penalty: " << c.control_cycles << " cycles\n";
+    }
+
+    const char* separator = "Data stalls by register: ";
+    for (int r = 0; r < NUM_INT_REGS; ++r) {
+        if (c.data_stalls_by_register[r] > 0) {
+            out << separator << "x" << r << " " << c.data_stalls_by_register[r];
+            separator = ", ";
+        }
+    }
+    if (separator[0] == ',') {
+        out << "\n";
+    }
+
+    separator = "Instruction mix: ";
+    for (int k = 0; k < NUM_OP_CLASSES; ++k) {
+        if (c.by_class[k] > 0) {
+            out << separator << op_class_name((OpClass)k) << " " << c.by_class[k];
+            separator = ", ";
+        }
+    }
+    if (separator[0] == ',') {
+        out << "\n";
+    }
+    out.flush();
+}
+
+void write_counters_fields(ostream& out, const PerfCounters& c) {
+    out << "\"instructions\": " << c.instructions;
+    out << ", \"cycles\": " << c.cycles;
+    {
+        SavedFormat saved(out);
+        out << ", \"cpi\": " << fixed << setprecision(6) << c.cpi();
+    }
+    out << ", \"stall_cycles\": " << c.stall_cycles;
+    out << ", \"stalls\": {";
+    for (int s = 0; s < NUM_STALL_CAUSES; ++s) {
+        out << (s ? ", " : "") << "\"" << json_cause_names[s] << "\": " << c.stalls[s];
+    }
+    out << "}, \"control_cycles\": " << c.control_cycles;
+    out << ", \"squashed\": " << c.squashed;
+    out << ", \"data_stalls_by_register\": {";
+    bool first = true;
+    for (int r = 0; r < NUM_INT_REGS; ++r) {
+        if (c.data_stalls_by_register[r] > 0) {
+            out << (first ? "" : ", ") << "\"x" << r << "\": " << c.data_stalls_by_register[r];
+            first = false;
+        }
+    }
+    out << "}, \"instruction_mix\": {";
+    for (int k = 0; k < NUM_OP_CLASSES; ++k) {
+        out << (k ? ", " : "") << "\"" << op_class_name((OpClass)k) << "\": " << c.by_class[k];
+    }
+    out << "}";
+}
+
+void write_counters_json(ostream& out, const PerfCounters& c) {
+    out << "{";
+    write_counters_fields(out, c);
+    out << "}\n";
+    out.flush();
+}
@@ -0,0 +1,77 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <cstdint>
+#include <iostream>
+
+#include "decode.h"
+
+// Why an instruction spent a cycle waiting between two stages
+enum StallCause {
+    STALL_RAW,          // operand not ready yet
+    STALL_LOAD_USE,     // operand not ready, and its producer is a load
+    STALL_STRUCTURAL,   // the next stage is still held by the instruction ahead
+    STALL_ICACHE,       // instruction cache miss
+    STALL_DCACHE,       // data cache miss
+    STALL_LOAD_LATENCY, // extra cycles every load spends in MEM
+    STALL_EXECUTE,      // extra cycles of a multi-cycle unit (MUL, DIV)
+    STALL_COMMIT,       // done, waiting to commit in order (out-of-order mode)
+    NUM_STALL_CAUSES
+};
+
+const int NUM_OP_CLASSES = (int)OpClass::UNKNOWN + 1;
+const int NUM_INT_REGS = 32;
+
+const char* stall_cause_name(StallCause cause);
+
+// Run-wide counters, updated as instructions go through the pipeline. Only
+// retired instructions are counted; the stall causes add up to
+// stall_cycles. Control hazards do not stall an instruction, they delay
+// the fetch of the correct path, so they are counted separately.
+struct PerfCounters {
+    uint64_t instructions = 0;
+    uint64_t squashed = 0;
+    uint64_t cycles = 0;
+    uint64_t stall_cycles = 0;
+    uint64_t stalls[NUM_STALL_CAUSES] = {};
+    uint64_t data_stalls_by_register[NUM_INT_REGS] = {};  // RAW and load-use
+    uint64_t control_cycles = 0;     // fetch cycles lost to mispredictions
+    uint64_t by_class[NUM_OP_CLASSES] = {};
+
+    double cpi() const { return instructions > 0 ? (double)cycles / instructions : 0.0; }
+
+    // Sum in another run's counters (cycles add up as if run back to back)
+    void add(const PerfCounters& other);
+    // Take out counts that other (an earlier state of the same run) already
+    // had. cycles is subtracted like the rest.
+    void subtract(const PerfCounters& other);
+};
+
+// Puts a stream's number format (flags and precision) back as it was when
+// it goes out of scope, so printers can use fixed and setprecision freely
+class SavedFormat {
+public:
+    explicit SavedFormat(std::ostream& out) : out(out), flags(out.flags()), precision(out.precision()) {}
+    ~SavedFormat() {
+        out.flags(flags);
+        out.precision(precision);
+    }
+    SavedFormat(const SavedFormat&) = delete;
+    SavedFormat& operator=(const SavedFormat&) = delete;
+
+private:
+    std::ostream& out;
+    std::ios::fmtflags flags;
+    std::streamsize precision;
+};
+
+// Human readable summary block
+void print_counters(std::ostream& out, const PerfCounters& c);
+
+// The same numbers as a single JSON object
+void write_counters_json(std::ostream& out, const PerfCounters& c);
+
+// Just the members of that object, for embedding in a larger one
+void write_counters_fields(std::ostream& out, const PerfCounters& c);
+
+#endif
@@ -0,0 +1,331 @@
+#include "cpu.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+#include "serialize.h"
+
+using namespace std;
+
+static const char* const abi_names[32] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2",
+    "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7",
+    "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"
+};
+
+const uint8_t* Memory::find_page(uint32_t addr) const {
+    uint32_t number = addr >> PAGE_BITS;
+    if (number == cached_number) {
+        return cached_page;
+    }
+    auto it = pages.find(number);
+    uint8_t* page = it != pages.end() ? it->second.get() : fault_in(number);
+    if (!page) {
+        return nullptr;
+    }
+    cached_number = number;
+    cached_page = page;
+    return cached_page;
+}
+
+// Allocate page `number` and fill it from the segments that overlap it.
+// Returns null, allocating nothing, if there are none.
+uint8_t* Memory::fault_in(uint32_t number) const {
+    uint64_t start = (uint64_t)number << PAGE_BITS;
+    uint64_t end = start + PAGE_SIZE;
+    uint8_t* page = nullptr;
+    for (const auto& segment : segments) {
+        uint64_t seg_start = segment.addr;
+        if (seg_start >= end || seg_start + segment.mem_size <= start) {
+            continue;
+        }
+        if (!page) {
+            auto& slot = pages[number];
+            slot.reset(new uint8_t[PAGE_SIZE]());
+            page = slot.get();
+        }
+        uint64_t from = max(start, seg_start);
+        uint64_t to = min(end, seg_start + segment.file_size);
+        if (from < to) {
+            memcpy(page + (from - start), segment.data + (from - seg_start), to - from);
+        }
+    }
+    return page;
+}
+
+void Memory::map_segment(uint32_t addr, const uint8_t* data, uint32_t file_size, uint32_t mem_size) {
+    segments.push_back(Segment{addr, file_size, mem_size, data});
+}
+
+uint8_t* Memory::page_for_write(uint32_t addr) {
+    uint32_t number = addr >> PAGE_BITS;
+    if (number == cached_number) {
+        return cached_page;
+    }
+    auto it = pages.find(number);
+    uint8_t* page = it != pages.end() ? it->second.get() : fault_in(number);
+    if (!page) {
+        auto& slot = pages[number];
+        slot.reset(new uint8_t[PAGE_SIZE]());
+        page = slot.get();
+    }
+    cached_number = number;
+    cached_page = page;
+    return cached_page;
+}
+
+uint8_t Memory::load8(uint32_t addr) const {
+    const uint8_t* page = find_page(addr);
+    return page ? page[addr & (PAGE_SIZE - 1)] : 0;
+}
+
+uint16_t Memory::load16(uint32_t addr) const {
+    return load8(addr) | (uint16_t)(load8(addr + 1) << 8);
+}
+
+uint32_t Memory::load32(uint32_t addr) const {
+    uint32_t offset = addr & (PAGE_SIZE - 1);
+    if (offset <= PAGE_SIZE - 4) {
+        const uint8_t* page = find_page(addr);
+        if (!page) {
+            return 0;
+        }
+        return page[offset] | (page[offset + 1] << 8) | (page[offset + 2] << 16) |
+               ((uint32_t)page[offset + 3] << 24);
+    }
+    return load16(addr) | ((uint32_t)load16(addr + 2) << 16);
+}
+
+void Memory::store8(uint32_t addr, uint8_t value) {
+    page_for_write(addr)[addr & (PAGE_SIZE - 1)] = value;
+}
+
+void Memory::store16(uint32_t addr, uint16_t value) {
+    store8(addr, value & 0xff);
+    store8(addr + 1, value >> 8);
+}
+
+void Memory::store32(uint32_t addr, uint32_t value) {
+    store16(addr, value & 0xffff);
+    store16(addr + 2, value >> 16);
+}
+
+void Memory::write_bytes(uint32_t addr, const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    for (size_t i = 0; i < size; ++i) {
+        store8(addr + i, bytes[i]);
+    }
+}
+
+void Memory::save(ostream& out) const {
+    uint64_t count = pages.size();
+    put_pod(out, count);
+    for (const auto& page : pages) {
+        put_pod(out, page.first);
+        out.write((const char*)page.second.get(), PAGE_SIZE);
+    }
+}
+
+bool Memory::load(istream& in) {
+    pages.clear();
+    cached_number = ~0u;
+    cached_page = nullptr;
+    uint64_t count;
+    if (!get_pod(in, count)) {
+        return false;
+    }
+    for (uint64_t k = 0; k < count; ++k) {
+        uint32_t number;
+        if (!get_pod(in, number)) {
+            return false;
+        }
+        auto& page = pages[number];
+        page.reset(new uint8_t[PAGE_SIZE]);
+        if (!in.read((char*)page.get(), PAGE_SIZE)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Cpu::step(const InstructionInfo& inst) {
+    uint32_t a = regs[inst.rs1];
+    uint32_t b = regs[inst.rs2];
+    uint32_t imm = (uint32_t)inst.imm;
+    uint32_t next_pc = pc + inst.size;
+    uint32_t result = 0;
+
+    switch (inst.type) {
+        case OpClass::R:
+            switch (inst.funct3) {
+                case 0: result = inst.funct7 == 0x20 ? a - b : a + b; break;
+                case 1: result = a << (b & 0x1f); break;
+                case 2: result = (int32_t)a < (int32_t)b; break;
+                case 3: result = a < b; break;
+                case 4: result = a ^ b; break;
+                case 5: result = inst.funct7 == 0x20 ? (uint32_t)((int32_t)a >> (b & 0x1f)) : a >> (b & 0x1f); break;
+                case 6: result = a | b; break;
+                case 7: result = a & b; break;
+            }
+            break;
+        case OpClass::I:
+            switch (inst.funct3) {
+                case 0: result = a + imm; break;
+                case 1: result = a << inst.rs2; break;
+                case 2: result = (int32_t)a < (int32_t)imm; break;
+                case 3: result = a < imm; break;
+                case 4: result = a ^ imm; break;
+                case 5: result = inst.funct7 == 0x20 ? (uint32_t)((int32_t)a >> inst.rs2) : a >> inst.rs2; break;
+                case 6: result = a | imm; break;
+                case 7: result = a & imm; break;
+            }
+            break;
+        case OpClass::LOAD:
+            switch (inst.funct3) {
+                case 0: result = (int32_t)(int8_t)memory.load8(a + imm); break;
+                case 1: result = (int32_t)(int16_t)memory.load16(a + imm); break;
+                case 2: result = memory.load32(a + imm); break;
+                case 4: result = memory.load8(a + imm); break;
+                case 5: result = memory.load16(a + imm); break;
+            }
+            break;
+        case OpClass::STORE:
+            switch (inst.funct3) {
+                case 0: memory.store8(a + imm, b & 0xff); break;
+                case 1: memory.store16(a + imm, b & 0xffff); break;
+                case 2: memory.store32(a + imm, b); break;
+            }
+            break;
+        case OpClass::BRANCH: {
+            bool taken = false;
+            switch (inst.funct3) {
+                case 0: taken = a == b; break;
+                case 1: taken = a != b; break;
+                case 4: taken = (int32_t)a < (int32_t)b; break;
+                case 5: taken = (int32_t)a >= (int32_t)b; break;
+                case 6: taken = a < b; break;
+                case 7: taken = a >= b; break;
+            }
+            if (taken) {
+                next_pc = pc + imm;
+            }
+            break;
+        }
+        case OpClass::LUI:
+            result = imm;
+            break;
+        case OpClass::AUIPC:
+            result = pc + imm;
+            break;
+        case OpClass::JAL:
+            result = next_pc;
+            next_pc = pc + imm;
+            break;
+        case OpClass::JALR:
+            result = next_pc;
+            next_pc = (a + imm) & ~1u;
+            break;
+        case OpClass::MUL: {
+            int64_t sa = (int32_t)a, sb = (int32_t)b;
+            switch (inst.funct3) {
+                case 0: result = a * b; break;
+                case 1: result = (uint32_t)((sa * sb) >> 32); break;
+                case 2: result = (uint32_t)((sa * (int64_t)(uint64_t)b) >> 32); break;
+                default: result = (uint32_t)(((uint64_t)a * b) >> 32); break;
+            }
+            break;
+        }
+        case OpClass::DIV: {
+            // Division by zero and overflow give the results the spec defines
+            int32_t sa = (int32_t)a, sb = (int32_t)b;
+            bool overflow = sa == INT32_MIN && sb == -1;
+            switch (inst.funct3) {
+                case 4: result = b == 0 ? ~0u : overflow ? a : (uint32_t)(sa / sb); break;
+                case 5: result = b == 0 ? ~0u : a / b; break;
+                case 6: result = b == 0 ? a : overflow ? 0 : (uint32_t)(sa % sb); break;
+                default: result = b == 0 ? a : a % b; break;
+            }
+            break;
+        }
+        case OpClass::SYSTEM:
+            // No CSRs are modelled: reads give 0 and writes are dropped.
+            // The only system call is exit; ebreak does nothing.
+            if (inst.funct3 == 0 && inst.imm == 0 && (regs[17] == 93 || regs[17] == 94)) {
+                halted = true;
+            }
+            result = 0;
+            break;
+        default:
+            // FENCE, and unrecognised instructions, execute as no-ops
+            break;
+    }
+
+    if (has_output_register(inst) && inst.rd != 0) {
+        regs[inst.rd] = result;
+    }
+    pc = next_pc;
+}
+
+static bool parse_register(const string& name, int& reg) {
+    if (name.size() >= 2 && name[0] == 'x') {
+        char* end;
+        long n = strtol(name.c_str() + 1, &end, 10);
+        if (*end == '\0' && n >= 0 && n < 32) {
+            reg = (int)n;
+            return true;
+        }
+    }
+    for (int r = 0; r < 32; ++r) {
+        if (name == abi_names[r]) {
+            reg = r;
+            return true;
+        }
+    }
+    if (name == "fp") {
+        reg = 8;
+        return true;
+    }
+    return false;
+}
+
+static bool parse_number(const string& text, uint32_t& value) {
+    if (text.empty()) {
+        return false;
+    }
+    char* end;
+    long long n = strtoll(text.c_str(), &end, 0);
+    if (*end != '\0') {
+        return false;
+    }
+    value = (uint32_t)n;
+    return true;
+}
+
+bool set_register_arg(Cpu& cpu, const string& arg) {
+    size_t eq = arg.find('=');
+    int reg;
+    uint32_t value;
+    if (eq == string::npos || !parse_register(arg.substr(0, eq), reg) ||
+        !parse_number(arg.substr(eq + 1), value)) {
+        return false;
+    }
+    if (reg != 0) {
+        cpu.regs[reg] = value;
+    }
+    return true;
+}
+
+bool set_string_arg(Cpu& cpu, const string& arg) {
+    size_t eq = arg.find('=');
+    uint32_t addr;
+    if (eq == string::npos || !parse_number(arg.substr(0, eq), addr)) {
+        return false;
+    }
+    string text = arg.substr(eq + 1);
+    cpu.memory.write_bytes(addr, text.c_str(), text.size() + 1);
+    return true;
+}
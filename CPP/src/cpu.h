@@ -0,0 +1,83 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "decode.h"
+
+// Sparse byte-addressed memory. 4 KiB pages are allocated on first write;
+// reads from untouched pages return zero. Ranges can be backed by mapped
+// bytes (ELF segments), which are only copied in, a page at a time, when
+// that page is first touched.
+class Memory {
+public:
+    static const uint32_t PAGE_BITS = 12;
+    static const uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+
+    uint8_t load8(uint32_t addr) const;
+    uint16_t load16(uint32_t addr) const;
+    uint32_t load32(uint32_t addr) const;
+
+    void store8(uint32_t addr, uint8_t value);
+    void store16(uint32_t addr, uint16_t value);
+    void store32(uint32_t addr, uint32_t value);
+
+    void write_bytes(uint32_t addr, const void* data, size_t size);
+
+    // Back [addr, addr + mem_size) with data; bytes past file_size read as
+    // zero. data must outlive the memory.
+    void map_segment(uint32_t addr, const uint8_t* data, uint32_t file_size, uint32_t mem_size);
+
+    // Checkpoint support: every allocated page with its number
+    void save(std::ostream& out) const;
+    bool load(std::istream& in);
+
+private:
+    struct Segment {
+        uint32_t addr;
+        uint32_t file_size;
+        uint32_t mem_size;
+        const uint8_t* data;
+    };
+
+    const uint8_t* find_page(uint32_t addr) const;
+    uint8_t* page_for_write(uint32_t addr);
+    uint8_t* fault_in(uint32_t number) const;
+
+    // Mutable because a read can fault in a mapped page
+    mutable std::unordered_map<uint32_t, std::unique_ptr<uint8_t[]>> pages;
+    std::vector<Segment> segments;
+    // Last page touched, to skip the hash lookup for sequential accesses
+    mutable uint32_t cached_number = ~0u;
+    mutable uint8_t* cached_page = nullptr;
+};
+
+// Architectural state of an RV32I hart.
+struct Cpu {
+    uint32_t pc = 0;
+    uint32_t regs[32] = {};
+    Memory memory;
+    // Set by an exit system call (ecall with a7 = 93 or 94)
+    bool halted = false;
+
+    // Execute one instruction and advance pc.
+    void step(const InstructionInfo& inst);
+};
+
+// Load address of the program text and the initial stack pointer.
+const uint32_t TEXT_BASE = 0x00010000;
+const uint32_t STACK_TOP = 0x7ffffff0;
+
+// Parse "xN=value" (or an ABI name such as a0=value) into the registers.
+bool set_register_arg(Cpu& cpu, const std::string& arg);
+
+// Parse "address=text" and store text, NUL-terminated, at address.
+bool set_string_arg(Cpu& cpu, const std::string& arg);
+
+#endif
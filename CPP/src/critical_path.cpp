@@ -0,0 +1,135 @@
+#include "critical_path.h"
+
+#include <algorithm>
+#include <iomanip>
+#include <ostream>
+
+using namespace std;
+
+// Cycles from fetch to EXE: an instruction fetched in cycle c is in ID in
+// c + 1 and can start EXE in c + 2
+static const uint64_t FETCH_TO_EXE = 2;
+
+DependencyAnalyzer::DependencyAnalyzer(const LatencyTable& latency, int load_latency, unsigned width)
+    : latency(latency), load_latency(load_latency), width(max(width, 1u)) {}
+
+static int distance_bucket(uint64_t distance) {
+    if (distance <= 4) {
+        return (int)distance - 1;
+    }
+    if (distance <= 8) {
+        return 4;
+    }
+    if (distance <= 16) {
+        return 5;
+    }
+    return distance <= 64 ? 6 : 7;
+}
+
+const char* DependencyAnalyzer::bucket_name(int bucket) {
+    static const char* const names[NUM_DISTANCE_BUCKETS] = {"1", "2", "3", "4", "5-8", "9-16", "17-64", "65+"};
+    return names[bucket];
+}
+
+// Source register reg holds back the instruction being added until it is
+// ready; a store's address register is only needed offset cycles later,
+// in MEM
+void DependencyAnalyzer::read(int reg, uint64_t offset, uint64_t& start, uint64_t& start_width,
+                              uint64_t& chain) {
+    if (reg == 0 || reg >= NUM_INT_REGS) {
+        return;
+    }
+    if (producer[reg] == 0) {
+        live_in += 1;
+        return;
+    }
+    uint64_t distance = count + 1 - producer[reg];
+    distances[distance_bucket(distance)] += 1;
+    reads[reg] += 1;
+    distance_sum[reg] += distance;
+    adjacent[reg] += distance == 1;
+
+    start = max(start, ready[reg] > offset ? ready[reg] - offset : 0);
+    start_width = max(start_width, ready_width[reg] > offset ? ready_width[reg] - offset : 0);
+    chain = max(chain, depth[reg]);
+}
+
+void DependencyAnalyzer::add(const InstructionInfo& inst) {
+    uint64_t exe = latency[inst.type];
+    // Relative to an unlimited fetch, where everything could start in
+    // cycle 0; absolute cycles for width-limited fetch
+    uint64_t start = 0;
+    uint64_t start_width = count / width + 1 + FETCH_TO_EXE;
+    uint64_t chain = 0;
+    if (inst.type == OpClass::STORE) {
+        read(inst.rs2, 0, start, start_width, chain);
+        read(inst.rs1, exe, start, start_width, chain);
+    } else {
+        if (reads_rs1(inst)) {
+            read(inst.rs1, 0, start, start_width, chain);
+        }
+        if (reads_rs2(inst)) {
+            read(inst.rs2, 0, start, start_width, chain);
+        }
+    }
+
+    // A loaded value comes out of MEM, anything else out of EXE
+    uint64_t mem = 1 + (inst.type == OpClass::LOAD ? load_latency : 0);
+    uint64_t result = exe + (inst.type == OpClass::LOAD ? mem : 0);
+    uint64_t finish = start + result;
+    if (finish > path_length || (finish == path_length && chain + 1 > path_depth)) {
+        path_length = finish;
+        path_depth = chain + 1;
+    }
+    last_wb = max(last_wb, start + 1 + FETCH_TO_EXE + exe + mem);
+    last_wb_width = max(last_wb_width, start_width + exe + mem);
+
+    count += 1;
+    if (has_output_register(inst) && inst.rd != 0 && inst.rd < NUM_INT_REGS) {
+        ready[inst.rd] = finish;
+        ready_width[inst.rd] = start_width + result;
+        depth[inst.rd] = chain + 1;
+        producer[inst.rd] = count;
+    }
+}
+
+void print_dependency_report(ostream& out, const DependencyAnalyzer& a) {
+    SavedFormat saved(out);
+    out << "Instructions: " << a.instructions() << "\n";
+    out << "Critical path: " << a.path_cycles() << " cycles, " << a.path_instructions() << " instructions\n";
+    out << "Available ILP: " << fixed << setprecision(3) << a.ilp() << "\n";
+    out << "Cycle bound: " << a.cycle_bound() << "\n";
+    out << "Cycle bound at width " << a.fetch_width() << ": " << a.width_cycle_bound() << "\n";
+    if (a.instructions() > 0) {
+        out << "CPI bound at width " << a.fetch_width() << ": " << fixed << setprecision(3)
+            << (double)a.width_cycle_bound() / a.instructions() << "\n";
+    }
+
+    const char* separator = "Dependency distance: ";
+    for (int b = 0; b < NUM_DISTANCE_BUCKETS; ++b) {
+        if (a.distances[b] > 0) {
+            out << separator << DependencyAnalyzer::bucket_name(b) << " " << a.distances[b];
+            separator = ", ";
+        }
+    }
+    if (separator[0] == ',') {
+        out << "\n";
+    }
+    if (a.live_in > 0) {
+        out << "Live-in operands: " << a.live_in << "\n";
+    }
+
+    bool header = false;
+    for (int r = 1; r < NUM_INT_REGS; ++r) {
+        if (a.reads[r] == 0) {
+            continue;
+        }
+        if (!header) {
+            out << "Register   Reads   Mean distance   Distance 1\n";
+            header = true;
+        }
+        out << left << setw(8) << ("x" + to_string(r)) << right << setw(8) << a.reads[r] << setw(16)
+            << setprecision(2) << (double)a.distance_sum[r] / a.reads[r] << setw(12) << setprecision(1)
+            << 100.0 * a.adjacent[r] / a.reads[r] << "%\n";
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef CRITICAL_PATH_H
+#define CRITICAL_PATH_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+
+#include "counters.h"
+#include "decode.h"
+#include "resources.h"
+
+// Dependency analysis (--critical-path): the register dataflow of an
+// instruction stream, without any pipeline. Each instruction starts as
+// soon as its source registers are ready and takes its EXE latency (a
+// load also its MEM cycle and --load-latency); its result is ready when
+// it finishes, as if every value were bypassed. The longest chain of
+// results is the critical path, and no pipeline with these latencies can
+// run the stream in fewer cycles. Memory dependences, cache misses,
+// branches and structural hazards are left out, so the bound is only
+// ever too low.
+//
+// Everything is per register, so the whole analysis is one pass over the
+// stream in constant memory.
+
+// Dependency distances (in instructions) are counted in these buckets
+const int NUM_DISTANCE_BUCKETS = 8;
+
+class DependencyAnalyzer {
+public:
+    DependencyAnalyzer(const LatencyTable& latency, int load_latency, unsigned width);
+
+    // The next instruction of the stream
+    void add(const InstructionInfo& inst);
+
+    // Longest chain of dependent results, in cycles and instructions
+    uint64_t path_cycles() const { return path_length; }
+    uint64_t path_instructions() const { return path_depth; }
+    uint64_t instructions() const { return count; }
+    // Instructions per cycle the dataflow allows
+    double ilp() const { return path_length ? (double)count / path_length : 0.0; }
+    // Fewest cycles (to the last WB, as the simulator counts them) for
+    // fetch of any width, and for fetch of width instructions per cycle
+    uint64_t cycle_bound() const { return last_wb; }
+    uint64_t width_cycle_bound() const { return last_wb_width; }
+    unsigned fetch_width() const { return width; }
+
+    static const char* bucket_name(int bucket);
+
+    // Source operands read, by how far back their producer was
+    uint64_t distances[NUM_DISTANCE_BUCKETS] = {};
+    // Source operands with no producer in the stream (live-in values)
+    uint64_t live_in = 0;
+    // Per register: operands read from a producer in the stream, their
+    // total distance, and how many came from the instruction just before
+    uint64_t reads[NUM_INT_REGS] = {};
+    uint64_t distance_sum[NUM_INT_REGS] = {};
+    uint64_t adjacent[NUM_INT_REGS] = {};
+
+private:
+    void read(int reg, uint64_t offset, uint64_t& start, uint64_t& start_width, uint64_t& chain);
+
+    LatencyTable latency;
+    int load_latency;
+    unsigned width;
+
+    // Per register: cycle its value is ready (with unlimited fetch and
+    // with width-limited fetch), length of the chain that produced it,
+    // and the index of its producer plus one (0: none yet)
+    uint64_t ready[NUM_INT_REGS] = {};
+    uint64_t ready_width[NUM_INT_REGS] = {};
+    uint64_t depth[NUM_INT_REGS] = {};
+    uint64_t producer[NUM_INT_REGS] = {};
+
+    uint64_t count = 0;
+    uint64_t path_length = 0;
+    uint64_t path_depth = 0;
+    uint64_t last_wb = 0;
+    uint64_t last_wb_width = 0;
+};
+
+void print_dependency_report(std::ostream& out, const DependencyAnalyzer& analysis);
+
+#endif
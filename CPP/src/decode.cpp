@@ -0,0 +1,247 @@
+#include "decode.h"
+
+#include <cctype>
+
+using namespace std;
+
+static int32_t sign_extend(uint32_t value, int bits) {
+    uint32_t m = 1u << (bits - 1);
+    return (int32_t)((value ^ m) - m);
+}
+
+const char* op_class_name(OpClass type) {
+    switch (type) {
+        case OpClass::R: return "R";
+        case OpClass::I: return "I";
+        case OpClass::LOAD: return "LOAD";
+        case OpClass::STORE: return "STORE";
+        case OpClass::BRANCH: return "BRANCH";
+        case OpClass::LUI: return "LUI";
+        case OpClass::AUIPC: return "AUIPC";
+        case OpClass::JAL: return "JAL";
+        case OpClass::JALR: return "JALR";
+        case OpClass::MUL: return "MUL";
+        case OpClass::DIV: return "DIV";
+        case OpClass::FENCE: return "FENCE";
+        case OpClass::SYSTEM: return "SYSTEM";
+        default: return "UNKNOWN";
+    }
+}
+
+bool parse_op_class(const string& name, OpClass& type) {
+    string upper = name;
+    for (auto& c : upper) {
+        c = (char)toupper((unsigned char)c);
+    }
+    for (int k = 0; k <= (int)OpClass::UNKNOWN; ++k) {
+        if (upper == op_class_name((OpClass)k)) {
+            type = (OpClass)k;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Encoders for the 32-bit formats, used to expand compressed instructions
+static uint32_t encode_r(uint32_t funct7, uint32_t rs2, uint32_t rs1, uint32_t funct3, uint32_t rd) {
+    return (funct7 << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | 0x33;
+}
+
+static uint32_t encode_i(int32_t imm, uint32_t rs1, uint32_t funct3, uint32_t rd, uint32_t opcode) {
+    return (((uint32_t)imm & 0xfff) << 20) | (rs1 << 15) | (funct3 << 12) | (rd << 7) | opcode;
+}
+
+static uint32_t encode_s(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+    uint32_t u = (uint32_t)imm;
+    return (((u >> 5) & 0x7f) << 25) | (rs2 << 20) | (rs1 << 15) | (funct3 << 12) | ((u & 0x1f) << 7) | 0x23;
+}
+
+static uint32_t encode_b(int32_t imm, uint32_t rs2, uint32_t rs1, uint32_t funct3) {
+    uint32_t u = (uint32_t)imm;
+    return (((u >> 12) & 1) << 31) | (((u >> 5) & 0x3f) << 25) | (rs2 << 20) | (rs1 << 15) |
+           (funct3 << 12) | (((u >> 1) & 0xf) << 8) | (((u >> 11) & 1) << 7) | 0x63;
+}
+
+static uint32_t encode_j(int32_t imm, uint32_t rd) {
+    uint32_t u = (uint32_t)imm;
+    return (((u >> 20) & 1) << 31) | (((u >> 1) & 0x3ff) << 21) | (((u >> 11) & 1) << 20) |
+           (((u >> 12) & 0xff) << 12) | (rd << 7) | 0x6f;
+}
+
+// Bit n of a compressed instruction, moved to bit position "to"
+static inline uint32_t bit(uint32_t half, int n, int to) {
+    return ((half >> n) & 1) << to;
+}
+
+uint32_t expand_compressed(uint16_t half) {
+    uint32_t h = half;
+    uint32_t funct3 = h >> 13;
+    uint32_t rd = (h >> 7) & 0x1f;            // also rs1 in the full-register forms
+    uint32_t rs2 = (h >> 2) & 0x1f;
+    uint32_t rd_short = ((h >> 2) & 7) + 8;   // rd' / rs2' (x8-x15)
+    uint32_t rs1_short = ((h >> 7) & 7) + 8;  // rs1' / rd'
+    // The 6-bit immediate of C.ADDI, C.LI, C.ANDI and friends
+    int32_t imm6 = sign_extend(bit(h, 12, 5) | ((h >> 2) & 0x1f), 6);
+    uint32_t shamt = bit(h, 12, 5) | ((h >> 2) & 0x1f);
+    // C.J / C.JAL offset
+    int32_t jump = sign_extend(bit(h, 12, 11) | bit(h, 11, 4) | bit(h, 10, 9) | bit(h, 9, 8) |
+                               bit(h, 8, 10) | bit(h, 7, 6) | bit(h, 6, 7) | bit(h, 5, 3) |
+                               bit(h, 4, 2) | bit(h, 3, 1) | bit(h, 2, 5), 12);
+    // C.BEQZ / C.BNEZ offset
+    int32_t branch = sign_extend(bit(h, 12, 8) | bit(h, 11, 4) | bit(h, 10, 3) | bit(h, 6, 7) |
+                                 bit(h, 5, 6) | bit(h, 4, 2) | bit(h, 3, 1) | bit(h, 2, 5), 9);
+    // C.LW / C.SW offset
+    uint32_t word_offset = bit(h, 12, 5) | bit(h, 11, 4) | bit(h, 10, 3) | bit(h, 6, 2) | bit(h, 5, 6);
+
+    switch (((h & 3) << 3) | funct3) {
+        // Quadrant 0
+        case 0x00: {  // C.ADDI4SPN
+            uint32_t imm = bit(h, 12, 5) | bit(h, 11, 4) | bit(h, 10, 9) | bit(h, 9, 8) | bit(h, 8, 7) |
+                           bit(h, 7, 6) | bit(h, 6, 2) | bit(h, 5, 3);
+            return imm ? encode_i((int32_t)imm, 2, 0, rd_short, 0x13) : 0;
+        }
+        case 0x02:  // C.LW
+            return encode_i((int32_t)word_offset, rs1_short, 2, rd_short, 0x03);
+        case 0x06:  // C.SW
+            return encode_s((int32_t)word_offset, rd_short, rs1_short, 2);
+
+        // Quadrant 1
+        case 0x08:  // C.ADDI (C.NOP when rd is x0)
+            return encode_i(imm6, rd, 0, rd, 0x13);
+        case 0x09:  // C.JAL
+            return encode_j(jump, 1);
+        case 0x0a:  // C.LI
+            return encode_i(imm6, 0, 0, rd, 0x13);
+        case 0x0b:
+            if (rd == 2) {  // C.ADDI16SP
+                int32_t imm = sign_extend(bit(h, 12, 9) | bit(h, 6, 4) | bit(h, 5, 6) | bit(h, 4, 8) |
+                                          bit(h, 3, 7) | bit(h, 2, 5), 10);
+                return imm ? encode_i(imm, 2, 0, 2, 0x13) : 0;
+            }
+            // C.LUI
+            return imm6 ? ((uint32_t)imm6 << 12) | (rd << 7) | 0x37 : 0;
+        case 0x0c:
+            switch ((h >> 10) & 3) {
+                case 0:  // C.SRLI
+                    return shamt < 32 ? encode_i((int32_t)shamt, rs1_short, 5, rs1_short, 0x13) : 0;
+                case 1:  // C.SRAI
+                    return shamt < 32 ? encode_i((int32_t)(shamt | 0x400), rs1_short, 5, rs1_short, 0x13) : 0;
+                case 2:  // C.ANDI
+                    return encode_i(imm6, rs1_short, 7, rs1_short, 0x13);
+                default:
+                    if (h & (1 << 12)) {
+                        return 0;
+                    }
+                    switch ((h >> 5) & 3) {
+                        case 0: return encode_r(0x20, rd_short, rs1_short, 0, rs1_short);  // C.SUB
+                        case 1: return encode_r(0, rd_short, rs1_short, 4, rs1_short);     // C.XOR
+                        case 2: return encode_r(0, rd_short, rs1_short, 6, rs1_short);     // C.OR
+                        default: return encode_r(0, rd_short, rs1_short, 7, rs1_short);    // C.AND
+                    }
+            }
+        case 0x0d:  // C.J
+            return encode_j(jump, 0);
+        case 0x0e:  // C.BEQZ
+            return encode_b(branch, 0, rs1_short, 0);
+        case 0x0f:  // C.BNEZ
+            return encode_b(branch, 0, rs1_short, 1);
+
+        // Quadrant 2
+        case 0x10:  // C.SLLI
+            return shamt < 32 ? encode_i((int32_t)shamt, rd, 1, rd, 0x13) : 0;
+        case 0x12: {  // C.LWSP
+            uint32_t imm = bit(h, 12, 5) | bit(h, 6, 4) | bit(h, 5, 3) | bit(h, 4, 2) | bit(h, 3, 7) | bit(h, 2, 6);
+            return rd ? encode_i((int32_t)imm, 2, 2, rd, 0x03) : 0;
+        }
+        case 0x14:
+            if (!(h & (1 << 12))) {
+                if (rs2 == 0) {  // C.JR
+                    return rd ? encode_i(0, rd, 0, 0, 0x67) : 0;
+                }
+                return encode_r(0, rs2, 0, 0, rd);  // C.MV
+            }
+            if (rs2 == 0) {
+                // C.EBREAK, or C.JALR
+                return rd == 0 ? 0x00100073 : encode_i(0, rd, 0, 1, 0x67);
+            }
+            return encode_r(0, rs2, rd, 0, rd);  // C.ADD
+        case 0x16: {  // C.SWSP
+            uint32_t imm = bit(h, 12, 5) | bit(h, 11, 4) | bit(h, 10, 3) | bit(h, 9, 2) | bit(h, 8, 7) | bit(h, 7, 6);
+            return encode_s((int32_t)imm, rs2, 2, 2);
+        }
+        default:
+            // Floating point loads/stores and reserved encodings
+            return 0;
+    }
+}
+
+InstructionInfo decode_word(uint32_t word) {
+    if ((word & 3) != 3 && (word >> 16) == 0) {
+        uint32_t expanded = expand_compressed((uint16_t)word);
+        InstructionInfo result = decode_word(expanded ? expanded : 0xffffffff);
+        result.size = 2;
+        return result;
+    }
+
+    InstructionInfo result;
+    result.type = OpClass::UNKNOWN;
+    result.rd = (word >> 7) & 0x1f;
+    result.rs1 = (word >> 15) & 0x1f;
+    result.rs2 = (word >> 20) & 0x1f;
+    result.funct3 = (word >> 12) & 0x7;
+    result.funct7 = (word >> 25) & 0x7f;
+    result.size = 4;
+    result.imm = 0;
+
+    switch (word & 0x7f) {
+        case 0x33: // R-type, or M extension when funct7 is 1
+            if (result.funct7 == 0x01) {
+                result.type = result.funct3 < 4 ? OpClass::MUL : OpClass::DIV;
+            } else {
+                result.type = OpClass::R;
+            }
+            break;
+        case 0x13: // I-type
+            result.type = OpClass::I;
+            result.imm = sign_extend(word >> 20, 12);
+            break;
+        case 0x03: // LOAD
+            result.type = OpClass::LOAD;
+            result.imm = sign_extend(word >> 20, 12);
+            break;
+        case 0x23: // STORE
+            result.type = OpClass::STORE;
+            result.imm = sign_extend(((word >> 25) << 5) | ((word >> 7) & 0x1f), 12);
+            break;
+        case 0x63: // BRANCH
+            result.type = OpClass::BRANCH;
+            result.imm = sign_extend(((word >> 31) << 12) | (((word >> 7) & 0x1) << 11) |
+                                     (((word >> 25) & 0x3f) << 5) | (((word >> 8) & 0xf) << 1), 13);
+            break;
+        case 0x37: // LUI
+            result.type = OpClass::LUI;
+            result.imm = (int32_t)(word & 0xfffff000);
+            break;
+        case 0x17: // AUIPC
+            result.type = OpClass::AUIPC;
+            result.imm = (int32_t)(word & 0xfffff000);
+            break;
+        case 0x6f: // JAL
+            result.type = OpClass::JAL;
+            result.imm = sign_extend(((word >> 31) << 20) | (((word >> 12) & 0xff) << 12) |
+                                     (((word >> 20) & 0x1) << 11) | (((word >> 21) & 0x3ff) << 1), 21);
+            break;
+        case 0x67: // JALR
+            result.type = OpClass::JALR;
+            result.imm = sign_extend(word >> 20, 12);
+            break;
+        case 0x0f: // FENCE, FENCE.I
+            result.type = OpClass::FENCE;
+            break;
+        case 0x73: // ECALL, EBREAK, CSR*; imm is the CSR number
+            result.type = OpClass::SYSTEM;
+            result.imm = (int32_t)(word >> 20);
+            break;
+    }
+    return result;
+}
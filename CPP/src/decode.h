@@ -0,0 +1,104 @@
+#ifndef DECODE_H
+#define DECODE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Opcode classes recognised by the ID stage.
+enum class OpClass : uint8_t {
+    R,
+    I,
+    LOAD,
+    STORE,
+    BRANCH,
+    LUI,
+    AUIPC,
+    JAL,
+    JALR,
+    MUL,      // M extension: mul, mulh, mulhsu, mulhu
+    DIV,      // M extension: div, divu, rem, remu
+    FENCE,    // fence, fence.i
+    SYSTEM,   // ecall, ebreak and the CSR instructions
+    UNKNOWN
+};
+
+// Plain decoded record for one instruction word. The whole program is
+// decoded once up front so the pipeline never touches strings.
+struct InstructionInfo {
+    OpClass type;
+    uint8_t rd;
+    uint8_t rs1;
+    uint8_t rs2;
+    uint8_t funct3;
+    uint8_t funct7;
+    uint8_t size;    // bytes: 4, or 2 for an expanded compressed instruction
+    int32_t imm;
+};
+
+// Which register fields the instruction actually uses.
+// ecall and ebreak have rd = 0, so only the CSR instructions really write.
+inline bool has_output_register(const InstructionInfo& inst) {
+    return inst.type == OpClass::R || inst.type == OpClass::I || inst.type == OpClass::LOAD ||
+           inst.type == OpClass::LUI || inst.type == OpClass::AUIPC ||
+           inst.type == OpClass::JAL || inst.type == OpClass::JALR ||
+           inst.type == OpClass::MUL || inst.type == OpClass::DIV || inst.type == OpClass::SYSTEM;
+}
+
+// CSR instructions with funct3 1-3 take rs1; 5-7 take an immediate there
+inline bool reads_rs1(const InstructionInfo& inst) {
+    return inst.type == OpClass::R || inst.type == OpClass::I || inst.type == OpClass::LOAD ||
+           inst.type == OpClass::STORE || inst.type == OpClass::BRANCH || inst.type == OpClass::JALR ||
+           inst.type == OpClass::MUL || inst.type == OpClass::DIV ||
+           (inst.type == OpClass::SYSTEM && inst.funct3 >= 1 && inst.funct3 <= 3);
+}
+
+inline bool reads_rs2(const InstructionInfo& inst) {
+    return inst.type == OpClass::R || inst.type == OpClass::STORE || inst.type == OpClass::BRANCH ||
+           inst.type == OpClass::MUL || inst.type == OpClass::DIV;
+}
+
+const char* op_class_name(OpClass type);
+
+// Parse a class name as printed by op_class_name(), in any case.
+bool parse_op_class(const std::string& name, OpClass& type);
+
+// The 32-bit instruction a 16-bit compressed (RVC) one stands for, or 0 if
+// it is not a valid RV32C instruction.
+uint32_t expand_compressed(uint16_t half);
+
+// A word with the low two bits not both set is a compressed instruction in
+// its low half (the upper half must be zero); it is expanded and decoded
+// with size 2.
+InstructionInfo decode_word(uint32_t word);
+
+// Decoded fields of many instructions, one array per field, as the bulk
+// decoder writes them. Row i holds the same values decode_word(words[i])
+// returns.
+struct DecodedColumns {
+    std::vector<uint8_t> type;   // OpClass
+    std::vector<uint8_t> rd;
+    std::vector<uint8_t> rs1;
+    std::vector<uint8_t> rs2;
+    std::vector<uint8_t> funct3;
+    std::vector<uint8_t> funct7;
+    std::vector<uint8_t> size;
+    std::vector<int32_t> imm;
+
+    size_t count() const { return type.size(); }
+    InstructionInfo row(size_t i) const;
+};
+
+// Bulk decode (predecode.cpp). Whole vectors of 32-bit words are decoded
+// at once with AVX2 or SSE4.1 when the CPU has them (checked once at run
+// time), or with plain code otherwise; compressed words go through
+// decode_word().
+void predecode_columns(const uint32_t* words, size_t count, DecodedColumns& columns);
+std::vector<InstructionInfo> predecode(const uint32_t* words, size_t count);
+
+// The instruction set both bulk decoders use: "avx2", "sse4.1" or
+// "generic"
+const char* predecode_isa();
+
+#endif
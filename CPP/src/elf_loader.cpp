@@ -0,0 +1,142 @@
+#include "elf_loader.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const uint8_t ELF_MAGIC[4] = {0x7f, 'E', 'L', 'F'};
+static const uint8_t ELFCLASS32 = 1;
+static const uint8_t ELFDATA2LSB = 1;
+static const uint16_t ET_EXEC = 2;
+static const uint16_t EM_RISCV = 243;
+static const uint32_t PT_LOAD = 1;
+static const uint32_t PF_X = 1;
+
+// ELF32 header and program header sizes and field offsets
+static const size_t EHDR_SIZE = 52;
+static const size_t PHDR_SIZE = 32;
+
+// Fields are little-endian whatever the host is
+static inline uint16_t read16(const uint8_t* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static inline uint32_t read32(const uint8_t* p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+bool is_elf_file(const string& path) {
+    if (path == "-") {
+        return false;
+    }
+    FILE* file = fopen(path.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    uint8_t magic[4];
+    bool elf = fread(magic, 1, sizeof(magic), file) == sizeof(magic) && memcmp(magic, ELF_MAGIC, 4) == 0;
+    fclose(file);
+    return elf;
+}
+
+bool ElfFile::open(const string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error_message = "Error opening " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        error_message = "Error reading " + path;
+        return false;
+    }
+    mapping_size = st.st_size;
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        error_message = "Error mapping " + path;
+        return false;
+    }
+    if (!parse((const uint8_t*)mapping, mapping_size)) {
+        error_message = path + ": " + error_message;
+        close();
+        return false;
+    }
+    return true;
+}
+
+void ElfFile::close() {
+    if (mapping) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+    loadable.clear();
+    entry_point = 0;
+}
+
+bool ElfFile::parse(const uint8_t* bytes, size_t size) {
+    if (size < EHDR_SIZE || memcmp(bytes, ELF_MAGIC, 4) != 0) {
+        error_message = "not an ELF file";
+        return false;
+    }
+    if (bytes[4] != ELFCLASS32 || bytes[5] != ELFDATA2LSB) {
+        error_message = "not a 32-bit little-endian ELF file";
+        return false;
+    }
+    if (read16(bytes + 16) != ET_EXEC || read16(bytes + 18) != EM_RISCV) {
+        error_message = "not a RISC-V executable";
+        return false;
+    }
+    entry_point = read32(bytes + 24);
+    uint32_t phoff = read32(bytes + 28);
+    uint16_t phentsize = read16(bytes + 42);
+    uint16_t phnum = read16(bytes + 44);
+    if (phentsize < PHDR_SIZE || phoff > size || (uint64_t)phnum * phentsize > size - phoff) {
+        error_message = "bad program header table";
+        return false;
+    }
+
+    for (uint16_t k = 0; k < phnum; ++k) {
+        const uint8_t* ph = bytes + phoff + (size_t)k * phentsize;
+        if (read32(ph) != PT_LOAD) {
+            continue;
+        }
+        uint32_t offset = read32(ph + 4);
+        ElfSegment segment;
+        segment.vaddr = read32(ph + 8);
+        segment.file_size = read32(ph + 16);
+        segment.mem_size = read32(ph + 20);
+        segment.executable = (read32(ph + 24) & PF_X) != 0;
+        if (offset > size || segment.file_size > size - offset || segment.mem_size < segment.file_size) {
+            error_message = "segment outside the file";
+            return false;
+        }
+        segment.data = bytes + offset;
+        loadable.push_back(segment);
+    }
+    if (!text_segment()) {
+        error_message = "no executable segment holds the entry point";
+        return false;
+    }
+    return true;
+}
+
+const ElfSegment* ElfFile::text_segment() const {
+    for (const auto& segment : loadable) {
+        if (segment.executable && entry_point >= segment.vaddr &&
+            entry_point - segment.vaddr < segment.file_size) {
+            return &segment;
+        }
+    }
+    return nullptr;
+}
@@ -0,0 +1,52 @@
+#ifndef ELF_LOADER_H
+#define ELF_LOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// A loadable (PT_LOAD) segment. data points into the file mapping; the
+// bytes from file_size up to mem_size (.bss) are zero.
+struct ElfSegment {
+    uint32_t vaddr;
+    uint32_t file_size;
+    uint32_t mem_size;
+    const uint8_t* data;
+    bool executable;
+};
+
+// True if the file starts with the ELF magic. Only the first bytes are read.
+bool is_elf_file(const std::string& path);
+
+// A statically linked RV32 little-endian executable. The file is mmapped
+// and the segments are views into the mapping, so nothing is copied until
+// the simulator touches it.
+class ElfFile {
+public:
+    ElfFile() {}
+    ~ElfFile() { close(); }
+    ElfFile(const ElfFile&) = delete;
+    ElfFile& operator=(const ElfFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+
+    bool is_open() const { return mapping != nullptr; }
+    uint32_t entry() const { return entry_point; }
+    const std::vector<ElfSegment>& segments() const { return loadable; }
+    // The executable segment holding the entry point, or null
+    const ElfSegment* text_segment() const;
+    const std::string& error() const { return error_message; }
+
+private:
+    bool parse(const uint8_t* bytes, size_t size);
+
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    uint32_t entry_point = 0;
+    std::vector<ElfSegment> loadable;
+    std::string error_message;
+};
+
+#endif
@@ -0,0 +1,693 @@
+#include <iostream>
+#include <iomanip>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+#include "engine.h"
+#include "serialize.h"
+
+using namespace std;
+
+Simulation::Simulation(const SimConfig& config)
+    : config(config), icache(config.icache), dcache(config.dcache), predictor(config.predictor) {
+    register_busy.clear();
+    for (int u = 0; u < NUM_UNITS; ++u) {
+        unit_limits[u] = config.units[u];
+    }
+    if (unit_limits[UNIT_ALU] == 0) {
+        unit_limits[UNIT_ALU] = config.issue_width;
+    }
+}
+
+bool Program::load(const string& path, string& error) {
+    if (is_elf_file(path)) {
+        return load_elf(path, error);
+    }
+    if (!trace.open(path)) {
+        error = trace.error();
+        return false;
+    }
+    insts = predecode(trace.data(), trace.size());
+    lay_out();
+    return true;
+}
+
+bool Program::load_trace(const char* bytes, size_t size, string& error) {
+    if (!trace.parse(bytes, size)) {
+        error = trace.error();
+        return false;
+    }
+    insts = predecode(trace.data(), trace.size());
+    lay_out();
+    return true;
+}
+
+// Split the text segment into instructions: 4 bytes when the low two bits
+// are set, 2 (compressed) otherwise. Decoding stops at a truncated one.
+bool Program::load_elf(const string& path, string& error) {
+    if (!elf.open(path)) {
+        error = elf.error();
+        return false;
+    }
+    const ElfSegment* text = elf.text_segment();
+    const uint8_t* bytes = text->data;
+    uint32_t offset = 0;
+    elf_words.clear();
+    while (offset + 2 <= text->file_size) {
+        uint32_t word = bytes[offset] | (bytes[offset + 1] << 8);
+        if ((word & 3) == 3) {
+            if (offset + 4 > text->file_size) {
+                break;
+            }
+            word |= (bytes[offset + 2] << 16) | ((uint32_t)bytes[offset + 3] << 24);
+            offset += 4;
+        } else {
+            offset += 2;
+        }
+        elf_words.push_back(word);
+    }
+    insts = predecode(elf_words.data(), elf_words.size());
+    base = text->vaddr;
+    entry = elf.entry();
+    lay_out();
+    return true;
+}
+
+void Program::lay_out() {
+    offsets.clear();
+    index_at.clear();
+    text_size = 0;
+    bool compressed = false;
+    for (const auto& inst : insts) {
+        text_size += inst.size;
+        compressed = compressed || inst.size == 2;
+    }
+    if (compressed) {
+        offsets.resize(insts.size());
+        index_at.assign(text_size / 2, NO_INSTRUCTION);
+        uint32_t offset = 0;
+        for (size_t i = 0; i < insts.size(); ++i) {
+            offsets[i] = offset;
+            index_at[offset / 2] = (uint32_t)i;
+            offset += insts[i].size;
+        }
+    }
+}
+
+bool parse_sample_config(const string& text, SampleConfig& config) {
+    size_t first = text.find(':');
+    size_t second = first == string::npos ? first : text.find(':', first + 1);
+    if (second == string::npos) {
+        return false;
+    }
+    SampleConfig c;
+    if (!parse_count(text.substr(0, first).c_str(), 1, UINT64_MAX, c.period) ||
+        !parse_count(text.substr(first + 1, second - first - 1).c_str(), 0, UINT64_MAX, c.warmup) ||
+        !parse_count(text.substr(second + 1).c_str(), 1, UINT64_MAX, c.size)) {
+        return false;
+    }
+    // Written so that warmup + size cannot wrap
+    if (c.warmup > c.period || c.size > c.period - c.warmup) {
+        return false;
+    }
+    config = c;
+    return true;
+}
+
+// Load the program and set up sp, and ra so that returning from the
+// top-level routine ends the run. ELF segments are mapped, not copied.
+void Simulation::reset_cpu() {
+    cpu = Cpu();
+    for (const auto& segment : program->elf.segments()) {
+        cpu.memory.map_segment(segment.vaddr, segment.data, segment.file_size, segment.mem_size);
+    }
+    for (size_t i = 0; !program->elf.is_open() && i < program->size(); ++i) {
+        if (program->insts[i].size == 2) {
+            cpu.memory.store16(program->pc_of(i), (uint16_t)program->words()[i]);
+        } else {
+            cpu.memory.store32(program->pc_of(i), program->words()[i]);
+        }
+    }
+    cpu.pc = program->entry;
+    cpu.regs[1] = program->end_pc();
+    cpu.regs[2] = STACK_TOP;
+}
+
+// Apply --reg and --string to the freshly reset cpu
+bool Simulation::setup_inputs() {
+    for (const auto& r : config.register_args) {
+        if (!set_register_arg(cpu, r)) {
+            error = "Bad --reg value " + r;
+            return false;
+        }
+    }
+    for (const auto& s : config.string_args) {
+        if (!set_string_arg(cpu, s)) {
+            error = "Bad --string value " + s;
+            return false;
+        }
+    }
+    return true;
+}
+
+void Simulation::fast_forward_one() {
+    uint32_t pc = cpu.pc;
+    const InstructionInfo& inst = program->insts[program->index_of(pc)];
+    if (icache.enabled()) {
+        icache.access(pc);
+    }
+    if (dcache.enabled() && (inst.type == OpClass::LOAD || inst.type == OpClass::STORE)) {
+        dcache.access(cpu.regs[inst.rs1] + inst.imm);
+    }
+    cpu.step(inst);
+    if (is_control(inst) && predictor.config().kind != PredictorKind::PERFECT) {
+        predictor.update(pc, inst, predictor.predict(pc, inst), cpu.pc);
+    }
+}
+
+static const char CHECKPOINT_MAGIC[4] = {'R', 'V', 'C', 'K'};
+static const uint32_t CHECKPOINT_VERSION = 1;
+
+// FNV-1a over the program words, to refuse checkpoints of another program
+static uint64_t program_hash(const Program& program) {
+    uint64_t hash = 14695981039346656037ull;
+    const uint8_t* bytes = (const uint8_t*)program.words();
+    for (size_t k = 0; k < program.size() * 4; ++k) {
+        hash = (hash ^ bytes[k]) * 1099511628211ull;
+    }
+    return hash;
+}
+
+void Simulation::maybe_checkpoint() {
+    if (position == config.checkpoint_at && !save_checkpoint(config.checkpoint_path)) {
+        cerr << "Cannot write checkpoint " << config.checkpoint_path << endl;
+    }
+}
+
+bool Simulation::save_checkpoint(const string& path) {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        return false;
+    }
+    out.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+    put_pod(out, CHECKPOINT_VERSION);
+    put_pod(out, program_hash(*program));
+    put_pod(out, position);
+    put_pod(out, cpu.pc);
+    put_pod(out, cpu.regs);
+    cpu.memory.save(out);
+    predictor.save(out);
+    icache.save(out);
+    dcache.save(out);
+    return (bool)out;
+}
+
+bool Simulation::load_checkpoint(const string& path) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        error = "Cannot open checkpoint " + path;
+        return false;
+    }
+    char magic[4];
+    uint32_t version;
+    uint64_t hash;
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) != 0 ||
+        !get_pod(in, version) || version != CHECKPOINT_VERSION) {
+        error = path + " is not a checkpoint";
+        return false;
+    }
+    if (!get_pod(in, hash) || hash != program_hash(*program)) {
+        error = path + " was saved from a different program";
+        return false;
+    }
+    if (!get_pod(in, position) || !get_pod(in, cpu.pc) || !get_pod(in, cpu.regs) ||
+        !cpu.memory.load(in)) {
+        error = path + " is truncated";
+        return false;
+    }
+    if (!predictor.load(in) || !icache.load(in) || !dcache.load(in)) {
+        error = path + " was saved with a different predictor or cache configuration";
+        return false;
+    }
+    return true;
+}
+
+void Simulation::account_row(size_t i, uint32_t word, const InstructionInfo& inst) {
+    // A sampled run only puts windows of the stream through a stale
+    // pipeline, so it has no continuous timeline to log
+    if (events && !config.sampling.enabled()) {
+        events->row(i, row_profile.pc, word, timeline.entry(i), row_profile.stalls);
+    }
+    PerfCounters& c = perf_counters;
+    if (timeline.is_squashed(i)) {
+        c.squashed += 1;
+        return;
+    }
+    c.instructions += 1;
+    c.by_class[(int)inst.type] += 1;
+    c.stall_cycles += timeline.stall_cycles(i);
+    uint64_t end = timeline.end_cycle(i);
+    if (end > c.cycles) {
+        c.cycles = end;
+    }
+    if (profile.enabled()) {
+        profile.add(program->index_of(row_profile.pc), row_profile);
+    }
+}
+
+// --critical-path: the dataflow of the listing, or of the instructions
+// --execute runs, through the dependency analyzer instead of the pipeline
+void Simulation::analyze_dependencies() {
+    DependencyAnalyzer analysis(config.latency, config.load_latency, config.issue_width);
+    size_t executed = 0;
+    if (config.execute) {
+        while (executed < config.max_instructions && !cpu.halted && in_text(cpu.pc)) {
+            const InstructionInfo& inst = program->insts[program->index_of(cpu.pc)];
+            analysis.add(inst);
+            cpu.step(inst);
+            executed += 1;
+        }
+    } else {
+        for (const InstructionInfo& inst : program->insts) {
+            analysis.add(inst);
+        }
+    }
+    if (config.mode == OUTPUT_NONE) {
+        return;
+    }
+    print_dependency_report(cout, analysis);
+    if (config.execute) {
+        print_halt_state(executed);
+    }
+}
+
+// In order, units are only booked a few latencies past the newest issue
+// cycle, so the default window does. Out of order, an instruction in the
+// issue queue can wait for a chain through everything else in the queue,
+// each link at most the longest latency plus a memory access, and books
+// its units that far ahead of the instructions still being dispatched.
+bool Simulation::size_unit_table() {
+    if (!config.ooo.enabled) {
+        return true;
+    }
+    uint64_t link = config.latency.longest() + config.memory_latency + config.load_latency + 1;
+    uint64_t span = (config.ooo.iq_size + 2) * link;
+    if (span > (uint64_t)MAX_UNIT_WINDOW) {
+        error = "--iq " + to_string(config.ooo.iq_size) + " is too large for these latencies (at most " +
+                to_string(MAX_UNIT_WINDOW / link - 2) + ")";
+        return false;
+    }
+    int window = UnitTable::DEFAULT_WINDOW;
+    while ((uint64_t)window < span) {
+        window *= 2;
+    }
+    units.resize(window);
+    return true;
+}
+
+bool Simulation::open_events() {
+    if (config.events_path.empty()) {
+        return true;
+    }
+    events.reset(new EventLog);
+    return events->open(config.events_path, error);
+}
+
+bool Simulation::close_events() {
+    if (!events) {
+        return true;
+    }
+    bool ok = events->close();
+    events.reset();
+    if (!ok) {
+        error = "Cannot write " + config.events_path;
+    }
+    return ok;
+}
+
+bool Simulation::report_profile() {
+    if (!profile.enabled() || config.mode == OUTPUT_NONE) {
+        return true;
+    }
+    if (config.profile) {
+        print_hotspots(cout, profile, *program, config.profile_top);
+    }
+    if (!config.folded_path.empty() && !write_folded_stacks(config.folded_path, profile, *program)) {
+        error = "Cannot write " + config.folded_path;
+        return false;
+    }
+    return true;
+}
+
+// Instruction words are shown as fixed-width hex
+static string word_label(uint32_t word) {
+    char text[9];
+    snprintf(text, sizeof(text), "%08x", word);
+    return text;
+}
+
+void Simulation::IF(size_t i) {
+    cycle_of_prev_IF = current_cycle;
+    timeline.enter(i, STAGE_IF, current_cycle);
+    current_cycle += 1;
+}
+
+void Simulation::ID(size_t i) {
+    timeline.enter(i, STAGE_ID, current_cycle);
+    current_cycle += 1;
+}
+
+void Simulation::EXE(size_t i) {
+    timeline.enter(i, STAGE_EXE, current_cycle);
+    current_cycle += 1;
+}
+
+void Simulation::MEM(size_t i) {
+    timeline.enter(i, STAGE_MEM, current_cycle);
+    current_cycle += 1;
+}
+
+void Simulation::print_table(const uint32_t* words, size_t count) {
+    // Every row ends by the last retired instruction's WB
+    int last_cycle = (int)min(perf_counters.cycles, (uint64_t)INT_MAX);
+    render_table(timeline, words, count, last_cycle, config.table_options, stdout);
+}
+
+void Simulation::print_stream_header() {
+    cout << "Instruction; IF; ID; EXE; MEM; WB; Stalls;\n";
+}
+
+void Simulation::print_stream_row(uint32_t word, size_t i) {
+    cout << word_label(word);
+    Stage last = timeline.last_stage(i);
+    for (int s = 0; s < NUM_STAGES; ++s) {
+        cout << "; ";
+        if (s <= last) {
+            cout << timeline.stage_cycle(i, (Stage)s);
+        }
+    }
+    if (last != STAGE_WB) {
+        cout << "; squashed;\n";
+    } else {
+        cout << "; " << timeline.stall_cycles(i) << ";\n";
+    }
+}
+
+// Parse "alu:mem:branch", three numbers from 1 to 1000
+static bool parse_unit_values(const string& text, unsigned values[NUM_UNITS]) {
+    unsigned parsed[NUM_UNITS];
+    const char* p = text.c_str();
+    for (int u = 0; u < NUM_UNITS; ++u) {
+        char* end;
+        unsigned long n = strtoul(p, &end, 10);
+        if (end == p || n == 0 || n > 1000 || *end != (u + 1 < NUM_UNITS ? ':' : '\0')) {
+            return false;
+        }
+        parsed[u] = (unsigned)n;
+        p = end + 1;
+    }
+    memcpy(values, parsed, sizeof(parsed));
+    return true;
+}
+
+// Parse "class=cycles,...", e.g. "mul=4,div=20"
+static bool parse_latency_list(const string& text, LatencyTable& table) {
+    LatencyTable parsed = table;
+    size_t start = 0;
+    while (true) {
+        size_t comma = text.find(',', start);
+        string item = text.substr(start, comma - start);
+        size_t equals = item.find('=');
+        OpClass type;
+        if (equals == string::npos || !parse_op_class(item.substr(0, equals), type)) {
+            return false;
+        }
+        char* end;
+        unsigned long cycles = strtoul(item.c_str() + equals + 1, &end, 10);
+        if (equals + 1 == item.size() || *end != '\0' || cycles < 1 || cycles > 1000) {
+            return false;
+        }
+        parsed.cycles[(int)type] = (int)cycles;
+        if (comma == string::npos) break;
+        start = comma + 1;
+    }
+    table = parsed;
+    return true;
+}
+
+const char* shared_output_option(const SimConfig& config) {
+    if (!config.events_path.empty()) {
+        return "--events";
+    }
+    if (!config.incremental_path.empty()) {
+        return "--incremental";
+    }
+    if (!config.checkpoint_path.empty()) {
+        return "--checkpoint";
+    }
+    return nullptr;
+}
+
+bool parse_count(const char* text, uint64_t min, uint64_t max, uint64_t& value) {
+    if (!isdigit((unsigned char)text[0])) {
+        return false;
+    }
+    errno = 0;
+    char* end;
+    unsigned long long n = strtoull(text, &end, 10);
+    if (*end != '\0' || errno == ERANGE || n < min || n > max) {
+        return false;
+    }
+    value = n;
+    return true;
+}
+
+int parse_config_option(int argc, char* argv[], int& a, SimConfig& config) {
+    string arg = argv[a];
+    if (arg == "--format" && a + 1 < argc) {
+        if (!parse_table_format(argv[++a], config.table_options.format)) {
+            cerr << "Unknown table format " << argv[a] << endl;
+            return -1;
+        }
+    } else if ((arg == "--cycles" || arg == "--rows") && a + 1 < argc) {
+        // Cycles are ints everywhere in the timeline
+        uint64_t first = 1, last = 0;
+        if (!parse_range(argv[++a], arg == "--cycles" ? INT_MAX : SIZE_MAX, first, last)) {
+            cerr << "Bad range " << argv[a] << endl;
+            return -1;
+        }
+        if (arg == "--cycles") {
+            config.table_options.first_cycle = (int)first;
+            config.table_options.last_cycle = (int)last;
+        } else {
+            config.table_options.first_row = first;
+            config.table_options.last_row = last;
+        }
+    } else if (arg == "--execute") {
+        config.execute = true;
+    } else if (arg == "--reg" && a + 1 < argc) {
+        config.register_args.push_back(argv[++a]);
+    } else if (arg == "--string" && a + 1 < argc) {
+        config.string_args.push_back(argv[++a]);
+    } else if (arg == "--max-instructions" && a + 1 < argc) {
+        uint64_t count;
+        if (!parse_count(argv[++a], 1, SIZE_MAX, count)) {
+            cerr << "Bad instruction count " << argv[a] << endl;
+            return -1;
+        }
+        config.max_instructions = count;
+    } else if (arg == "--predictor" && a + 1 < argc) {
+        if (!parse_predictor_kind(argv[++a], config.predictor.kind)) {
+            cerr << "Unknown predictor " << argv[a] << endl;
+            return -1;
+        }
+    } else if (arg == "--predictor-bits" && a + 1 < argc) {
+        uint64_t bits;
+        if (!parse_count(argv[++a], 1, MAX_PREDICTOR_BITS, bits)) {
+            cerr << "Bad predictor size " << argv[a] << " (1 to " << MAX_PREDICTOR_BITS << " bits)" << endl;
+            return -1;
+        }
+        config.predictor.table_bits = (unsigned)bits;
+        config.predictor.history_bits = config.predictor.table_bits;
+    } else if (arg == "--btb" && a + 1 < argc) {
+        uint64_t entries;
+        if (!parse_count(argv[++a], 0, MAX_BTB_ENTRIES, entries) || (entries & (entries - 1)) != 0) {
+            cerr << "Bad BTB size " << argv[a] << " (0 or a power of two up to " << MAX_BTB_ENTRIES << ")"
+                 << endl;
+            return -1;
+        }
+        config.predictor.btb_entries = (unsigned)entries;
+    } else if ((arg == "--icache" || arg == "--dcache") && a + 1 < argc) {
+        if (!parse_cache_config(argv[++a], arg == "--icache" ? config.icache : config.dcache)) {
+            cerr << "Bad cache configuration " << argv[a] << endl;
+            return -1;
+        }
+    } else if ((arg == "--mem-latency" || arg == "--load-latency") && a + 1 < argc) {
+        uint64_t cycles;
+        if (!parse_count(argv[++a], 0, MAX_MEMORY_LATENCY, cycles)) {
+            cerr << "Bad latency " << argv[a] << " (0 to " << MAX_MEMORY_LATENCY << " cycles)" << endl;
+            return -1;
+        }
+        (arg == "--mem-latency" ? config.memory_latency : config.load_latency) = (int)cycles;
+    } else if (arg == "--sample" && a + 1 < argc) {
+        if (!parse_sample_config(argv[++a], config.sampling)) {
+            cerr << "Bad sampling configuration " << argv[a] << endl;
+            return -1;
+        }
+    } else if (arg == "--checkpoint" && a + 1 < argc) {
+        string value = argv[++a];
+        size_t colon = value.find(':');
+        uint64_t count;
+        if (colon == string::npos || !parse_count(value.substr(0, colon).c_str(), 1, SIZE_MAX, count) ||
+            colon + 1 == value.size()) {
+            cerr << "Bad checkpoint " << value << " (expected count:file)" << endl;
+            return -1;
+        }
+        config.checkpoint_at = count;
+        config.checkpoint_path = value.substr(colon + 1);
+    } else if (arg == "--restore" && a + 1 < argc) {
+        config.restore_path = argv[++a];
+    } else if (arg == "--width" && a + 1 < argc) {
+        char* end;
+        unsigned long width = strtoul(argv[++a], &end, 10);
+        if (*end != '\0' || width < 1 || width > 16) {
+            cerr << "Bad issue width " << argv[a] << " (1 to 16)" << endl;
+            return -1;
+        }
+        config.issue_width = (unsigned)width;
+    } else if (arg == "--ooo") {
+        config.ooo.enabled = true;
+    } else if ((arg == "--rob" || arg == "--iq") && a + 1 < argc) {
+        char* end;
+        unsigned long size = strtoul(argv[++a], &end, 10);
+        if (*end != '\0' || size < 1 || size > 4096) {
+            cerr << "Bad " << arg.substr(2) << " size " << argv[a] << " (1 to 4096)" << endl;
+            return -1;
+        }
+        (arg == "--rob" ? config.ooo.rob_size : config.ooo.iq_size) = (unsigned)size;
+    } else if (arg == "--latency" && a + 1 < argc) {
+        if (!parse_latency_list(argv[++a], config.latency)) {
+            cerr << "Bad latencies " << argv[a] << " (expected class=cycles,..., e.g. mul=4,div=20)" << endl;
+            return -1;
+        }
+    } else if (arg == "--profile") {
+        config.profile = true;
+    } else if (arg == "--profile-top" && a + 1 < argc) {
+        char* end;
+        unsigned long top = strtoul(argv[++a], &end, 10);
+        if (*end != '\0' || top < 1) {
+            cerr << "Bad hotspot count " << argv[a] << endl;
+            return -1;
+        }
+        config.profile = true;
+        config.profile_top = top;
+    } else if (arg == "--folded" && a + 1 < argc) {
+        config.folded_path = argv[++a];
+    } else if (arg == "--events" && a + 1 < argc) {
+        config.events_path = argv[++a];
+    } else if (arg == "--critical-path") {
+        config.critical_path = true;
+    } else if (arg == "--incremental" && a + 1 < argc) {
+        config.incremental_path = argv[++a];
+    } else if (arg == "--units" && a + 1 < argc) {
+        if (!parse_unit_values(argv[++a], config.units)) {
+            cerr << "Bad unit counts " << argv[a] << " (expected alu:mem:branch)" << endl;
+            return -1;
+        }
+    } else {
+        return 0;
+    }
+    return 1;
+}
+
+bool write_counters_file(const string& path, const PerfCounters& counters) {
+    if (path.empty()) {
+        return true;
+    }
+    if (path == "-") {
+        write_counters_json(cout, counters);
+        return true;
+    }
+    ofstream out(path);
+    if (!out) {
+        cerr << "Cannot write " << path << endl;
+        return false;
+    }
+    write_counters_json(out, counters);
+    return true;
+}
+
+void Simulation::print_halt_state(size_t executed) {
+    cout << "Executed " << executed << " instructions";
+    if (executed == config.max_instructions) {
+        cout << " (instruction limit reached)";
+    }
+    char pc_text[11];
+    snprintf(pc_text, sizeof(pc_text), "0x%08x", cpu.pc);
+    cout << ", pc = " << pc_text << ", a0 = " << (int32_t)cpu.regs[10] << endl;
+}
+
+// Mean CPI over the sample windows, with a 95% confidence interval from
+// the spread between windows
+void Simulation::print_sample_report(size_t executed) {
+    const SampleConfig& s = config.sampling;
+    size_t n = sample_cpis.size();
+    cout << "Sampled " << n << " windows of " << s.size << " instructions (" << s.warmup
+         << " warmup) every " << s.period << ", " << executed << " instructions in total" << endl;
+    if (n == 0) {
+        cout << "No complete sample window; use a shorter period" << endl;
+        return;
+    }
+    double mean = 0;
+    for (double cpi : sample_cpis) {
+        mean += cpi;
+    }
+    mean /= n;
+    double variance = 0;
+    for (double cpi : sample_cpis) {
+        variance += (cpi - mean) * (cpi - mean);
+    }
+    double half_width = n > 1 ? 1.96 * sqrt(variance / (n - 1)) / sqrt((double)n) : 0.0;
+    SavedFormat saved(cout);
+    cout << "CPI: " << fixed << setprecision(3) << mean << " +/- " << half_width << " (95% confidence)" << endl;
+    cout << "Estimated cycles: " << (uint64_t)(mean * executed + 0.5) << endl;
+}
+
+void Simulation::print_predictor_stats() {
+    cout << "Branch predictor: " << predictor_kind_name(predictor.config().kind);
+    cout << ", " << predictor.lookups << " control transfers, " << predictor.mispredicts << " mispredicted";
+    if (predictor.lookups > 0) {
+        double accuracy = 100.0 * (predictor.lookups - predictor.mispredicts) / predictor.lookups;
+        SavedFormat saved(cout);
+        cout << " (" << fixed << setprecision(1) << accuracy << "% accuracy)";
+    }
+    if (predictor.btb_lookups > 0) {
+        cout << ", BTB hits " << predictor.btb_hits << "/" << predictor.btb_lookups << " taken";
+    }
+    cout << endl;
+}
+
+static void print_one_cache(const char* name, const Cache& cache) {
+    uint64_t accesses = cache.hits + cache.misses;
+    cout << name << ": " << accesses << " accesses, " << cache.hits << " hits, " << cache.misses << " misses";
+    if (accesses > 0) {
+        SavedFormat saved(cout);
+        cout << " (" << fixed << setprecision(1) << 100.0 * cache.hits / accesses << "% hit rate)";
+    }
+    cout << endl;
+}
+
+void Simulation::print_cache_stats() {
+    if (icache.enabled()) {
+        print_one_cache("L1I", icache);
+    }
+    if (dcache.enabled()) {
+        print_one_cache("L1D", dcache);
+    }
+}
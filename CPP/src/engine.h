@@ -0,0 +1,1228 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <queue>
+#include <string>
+#include <vector>
+
+#include "batch.h"
+#include "cache.h"
+#include "counters.h"
+#include "cpu.h"
+#include "critical_path.h"
+#include "decode.h"
+#include "elf_loader.h"
+#include "events.h"
+#include "hazard_policy.h"
+#include "incremental.h"
+#include "ooo.h"
+#include "predictor.h"
+#include "profile.h"
+#include "render.h"
+#include "resources.h"
+#include "scoreboard.h"
+#include "server.h"
+#include "timeline.h"
+#include "trace_loader.h"
+
+// Five-stage in-order pipeline shared by every simulator binary. The
+// hazard rules come from the Policy template parameter (hazard_policy.h).
+
+const int DEFAULT_MEMORY_LATENCY = 10;
+// Longest --mem-latency and --load-latency
+const int MAX_MEMORY_LATENCY = 1000;
+
+// Most cycles the unit table may keep (--ooo with a big issue queue and
+// long latencies needs many)
+const int MAX_UNIT_WINDOW = 1 << 22;
+
+// Timeline slots kept in --stream mode
+const size_t STREAM_WINDOW = 8;
+
+// Instruction limit for --execute unless --max-instructions is given
+const size_t DEFAULT_MAX_INSTRUCTIONS = 10000000;
+
+// What a run prints: the full table, one line per instruction as it
+// retires (--stream), only the counter summary (--stats), or nothing at
+// all (batch runs, which collect the counters instead)
+enum OutputMode {
+    OUTPUT_TABLE,
+    OUTPUT_STREAM,
+    OUTPUT_STATS,
+    OUTPUT_NONE
+};
+
+// Addresses one instruction uses, for the cache model. The data address
+// is only known when instructions are executed.
+struct AccessInfo {
+    uint32_t pc = 0;
+    uint32_t data_addr = 0;
+    bool has_data_addr = false;
+};
+
+// A trace, or the text of an ELF executable, decoded once. Simulations
+// only read it, so one copy can be shared by any number of them, on any
+// thread.
+struct Program {
+    TraceFile trace;
+    // For an ELF executable: the mapped file, and its text segment split
+    // into instruction words (compressed ones in the low half)
+    ElfFile elf;
+    std::vector<uint32_t> elf_words;
+    std::vector<InstructionInfo> insts;
+    // Address of the first instruction, and where execution starts
+    uint32_t base = TEXT_BASE;
+    uint32_t entry = TEXT_BASE;
+    // Layout when there are compressed (2-byte) instructions: the offset of
+    // each one from base, and the instruction starting at each halfword
+    // (NO_INSTRUCTION inside a 4-byte one). Without compressed instructions
+    // both stay empty and instruction i is at base + 4 * i.
+    static constexpr uint32_t NO_INSTRUCTION = ~0u;
+    std::vector<uint32_t> offsets;
+    std::vector<uint32_t> index_at;
+    uint32_t text_size = 0;
+
+    // Load a hex or binary trace, or an ELF executable
+    bool load(const std::string& path, std::string& error);
+    // Load a hex or binary trace that is already in memory
+    bool load_trace(const char* bytes, size_t size, std::string& error);
+    const uint32_t* words() const { return elf.is_open() ? elf_words.data() : trace.data(); }
+    size_t size() const { return insts.size(); }
+
+    uint32_t pc_of(size_t i) const { return base + (offsets.empty() ? 4 * (uint32_t)i : offsets[i]); }
+    uint32_t end_pc() const { return base + text_size; }
+    // True if an instruction starts at pc
+    bool contains(uint32_t pc) const {
+        uint32_t offset = pc - base;
+        if (pc < base || offset >= text_size) {
+            return false;
+        }
+        return offsets.empty() ? (offset & 3) == 0 : (offset & 1) == 0 && index_at[offset / 2] != NO_INSTRUCTION;
+    }
+    // Index of the instruction at pc, which contains() must accept
+    size_t index_of(uint32_t pc) const {
+        uint32_t offset = pc - base;
+        return offsets.empty() ? offset / 4 : index_at[offset / 2];
+    }
+
+private:
+    bool load_elf(const std::string& path, std::string& error);
+    void lay_out();
+};
+
+// Sampled simulation, SMARTS style: out of every period instructions the
+// last warmup + size run through the pipeline and the last size of those
+// are measured. The rest are only executed, keeping caches and the branch
+// predictor warm.
+struct SampleConfig {
+    uint64_t period = 0;   // 0 turns sampling off
+    uint64_t warmup = 0;
+    uint64_t size = 0;
+
+    bool enabled() const { return period > 0; }
+};
+
+// Parse "period:warmup:size", e.g. "100000:2000:1000".
+bool parse_sample_config(const std::string& text, SampleConfig& config);
+
+// Everything the command line controls about a run
+struct SimConfig {
+    OutputMode mode = OUTPUT_TABLE;
+    bool execute = false;
+    size_t max_instructions = DEFAULT_MAX_INSTRUCTIONS;
+    PredictorConfig predictor;
+    // Cache model: L1 instruction and data caches in front of a memory
+    // with a fixed miss latency. Disabled caches cost nothing.
+    CacheConfig icache;
+    CacheConfig dcache;
+    int memory_latency = DEFAULT_MEMORY_LATENCY;
+    // Extra cycles a load spends in MEM, which lengthens the load-use gap
+    int load_latency = 0;
+    std::vector<std::string> register_args;
+    std::vector<std::string> string_args;
+    // Format and window used by print_table()
+    RenderOptions table_options;
+    SampleConfig sampling;
+    // Save a checkpoint once checkpoint_at instructions have executed
+    uint64_t checkpoint_at = 0;
+    std::string checkpoint_path;
+    // Start from a saved checkpoint instead of the program entry
+    std::string restore_path;
+    // Superscalar mode: up to issue_width instructions in each stage, in
+    // order, with at most units[u] of them using unit u in a cycle. A width
+    // of 1 is the scalar pipeline, which has no unit limits.
+    unsigned issue_width = 1;
+    unsigned units[NUM_UNITS] = {0, 1, 1};   // 0 ALUs means one per slot
+    // Cycles each class of instruction spends in EXE (--latency)
+    LatencyTable latency;
+    // Out-of-order backend instead of the in-order stages (ignores the
+    // hazard policy: renaming and full bypassing leave only true
+    // dependences)
+    OooConfig ooo;
+    // Per-PC hotspot report (--profile) and flamegraph input (--folded)
+    bool profile = false;
+    size_t profile_top = 20;
+    std::string folded_path;
+
+    bool profiling() const { return profile || !folded_path.empty(); }
+    // Reuse the previous run of the listing saved in this file, and save
+    // this one there (--incremental)
+    std::string incremental_path;
+    // Keep every row of the timeline, as the table does, without printing
+    // it; callers read it through Simulation::rows()
+    bool keep_timeline = false;
+    // Report the register dataflow bound (--critical-path) instead of
+    // simulating the pipeline
+    bool critical_path = false;
+    // Write every row to this event log as it retires (--events)
+    std::string events_path;
+
+    bool keeps_timeline() const { return mode == OUTPUT_TABLE || keep_timeline; }
+};
+
+// All the state of one simulation. Nothing is shared between instances,
+// so separate simulations can run on separate threads.
+class Simulation {
+public:
+    explicit Simulation(const SimConfig& config);
+
+    // Load input_path ("-" for stdin) and simulate it as configured,
+    // printing whatever the output mode asks for. On failure returns false
+    // and leaves the reason in error.
+    template <class Policy>
+    bool run(const std::string& input_path);
+
+    // Simulate an already decoded program.
+    template <class Policy>
+    bool run(std::shared_ptr<const Program> program);
+
+    const PerfCounters& counters() const { return perf_counters; }
+    // The timeline of the last run when config.keeps_timeline(), and the
+    // words of its rows
+    const Timeline& rows() const { return timeline; }
+    const uint32_t* row_words() const {
+        return config.execute ? executed_words.data() : program->words();
+    }
+
+    std::string error;
+
+private:
+    void IF(size_t i);
+    void ID(size_t i);
+    void EXE(size_t i);
+    void MEM(size_t i);
+
+    int wait_for_previous(size_t i);
+    void wait_for_register(int reg);
+    void add_stall(StallCause cause, int cycles);
+    void add_data_stall(int reg, StallCause cause, int cycles);
+    int stage_free_cycle(size_t i, Stage stage) const;
+    int wait_for_slot(size_t i, Stage stage, Unit unit = NUM_UNITS, int unit_cycles = 1);
+    void claim_unit(Unit unit, int cycles);
+    int next_fetch_cycle(size_t row) const;
+    size_t ring_capacity() const;
+    bool size_unit_table();
+
+    // Out-of-order backend (ooo.cpp)
+    void issue_ooo(size_t i, const InstructionInfo& inst, const AccessInfo& access);
+    int ooo_fetch_cycle(size_t i) const;
+    void ooo_redirect(size_t row);
+
+    template <class Policy>
+    void issue(size_t i, const InstructionInfo& inst, const AccessInfo& access);
+    template <class Policy>
+    void issue_scalar(size_t i, const InstructionInfo& inst, const AccessInfo& access);
+    template <class Policy>
+    void issue_wide(size_t i, const InstructionInfo& inst, const AccessInfo& access);
+    template <class Policy>
+    void pipeline();
+    template <class Policy>
+    void stream_pipeline(TraceStream& in);
+    template <class Policy>
+    size_t fetch_wrong_path(size_t row, uint32_t pc, int resolve_cycle);
+    template <class Policy>
+    size_t execute_one(size_t row);
+    template <class Policy>
+    size_t execute_pipeline();
+    template <class Policy>
+    size_t sampled_pipeline();
+    template <class Policy>
+    bool simulate();
+    bool report_profile();
+    bool open_events();
+    bool close_events();
+    void analyze_dependencies();
+
+    // Incremental re-simulation (incremental.cpp)
+    template <class Policy>
+    void incremental_pipeline();
+    PipelineSnapshot take_snapshot(size_t row) const;
+    void restore_snapshot(const PipelineSnapshot& s);
+    PerfCounters rebase_counters(const PerfCounters& old_at, const PerfCounters& old_from, int shift) const;
+    uint64_t timing_fingerprint(PolicyKind kind) const;
+    void fast_forward_one();
+
+    // Checkpoints hold the functional state (registers, memory, position)
+    // and the warm caches and predictor, not the pipeline: a restored run
+    // starts with the pipeline empty.
+    void maybe_checkpoint();
+    bool save_checkpoint(const std::string& path);
+    bool load_checkpoint(const std::string& path);
+
+    void reset_cpu();
+    bool setup_inputs();
+    bool in_text(uint32_t pc) const;
+    void start_row(size_t i, uint32_t word);
+    void finish_row(size_t i, uint32_t word, const InstructionInfo& inst);
+    // Count instruction i, which has just reached WB or been squashed.
+    void account_row(size_t i, uint32_t word, const InstructionInfo& inst);
+
+    void print_table(const uint32_t* words, size_t count);
+    void print_stream_header();
+    void print_stream_row(uint32_t word, size_t i);
+    void print_halt_state(size_t executed);
+    void print_sample_report(size_t executed);
+    void print_predictor_stats();
+    void print_cache_stats();
+
+    SimConfig config;
+
+    Scoreboard register_busy;
+    Timeline timeline;
+    std::shared_ptr<const Program> program;
+    int current_cycle = 1;
+    int cycle_of_prev_IF = 0;
+    // Wide mode: nothing is fetched before this cycle (set after taken
+    // branches and mispredictions), and the units in use per cycle
+    int fetch_floor = 1;
+    // First cycle EXE is free again after a multi-cycle instruction
+    int exe_free = 0;
+    UnitTable units;
+    int unit_limits[NUM_UNITS];
+    // Out-of-order mode: operand availability, and the cycles the
+    // instructions waiting in the issue queue will issue in
+    RenameTable rename;
+    std::priority_queue<int, std::vector<int>, std::greater<int>> issue_queue;
+
+    Cache icache;
+    Cache dcache;
+
+    // Functional state for --execute, and the words it ran (for the table)
+    Cpu cpu;
+    BranchPredictor predictor;
+    std::vector<uint32_t> executed_words;
+
+    PerfCounters perf_counters;
+
+    // Hotspot profile (--profile, --folded): what the instruction being
+    // issued ran into, and the pc of the last instruction issued to write
+    // each register, for naming the producer a stall waited on
+    Profile profile;
+    RowProfile row_profile;
+    std::array<uint32_t, Scoreboard::NUM_REGS> writer_pc{};
+
+    // Instructions executed since the program entry, including any
+    // before the checkpoint this run was restored from
+    uint64_t position = 0;
+    // Measured CPI of each sample window
+    std::vector<double> sample_cpis;
+    // What --incremental reused, for the report
+    std::string incremental_note;
+    // Open while a run writes --events
+    std::unique_ptr<EventLog> events;
+};
+
+// Parse the command line option at argv[a] if it sets part of config,
+// moving a past any value it takes. Returns 1 if it did, 0 if the option
+// is not a config option, and -1 (after printing why) if its value is bad.
+int parse_config_option(int argc, char* argv[], int& a, SimConfig& config);
+
+// The option, if config has one, that makes every run write the same
+// file. Runs of a batch, a sweep or the server must not share it.
+const char* shared_output_option(const SimConfig& config);
+
+// Parse a whole decimal number between min and max (inclusive), without
+// signs or trailing characters
+bool parse_count(const char* text, uint64_t min, uint64_t max, uint64_t& value);
+
+// Write counters as JSON to path ("-" for stdout). An empty path writes
+// nothing.
+bool write_counters_file(const std::string& path, const PerfCounters& counters);
+
+// Hold instruction i while the one ahead of it is stalled. Returns the
+// number of cycles waited.
+inline int Simulation::wait_for_previous(size_t i) {
+    int start = current_cycle;
+    while (i > 0 && timeline.is_stalled(i - 1, current_cycle)) {
+        current_cycle += 1;
+    }
+    return current_cycle - start;
+}
+
+inline void Simulation::wait_for_register(int reg) {
+    int start = current_cycle;
+    while (register_busy.is_busy(reg, current_cycle)) {
+        current_cycle += 1;
+    }
+    if (current_cycle != start) {
+        bool load_use = register_busy.producer(reg) == OpClass::LOAD;
+        add_data_stall(reg, load_use ? STALL_LOAD_USE : STALL_RAW, current_cycle - start);
+    }
+}
+
+// Count cycles the instruction being issued stalled for, in the run's
+// counters and in its row profile
+inline void Simulation::add_stall(StallCause cause, int cycles) {
+    perf_counters.stalls[cause] += cycles;
+    row_profile.stalls[cause] += cycles;
+}
+
+// The same for a wait on reg, which is also charged to the register and
+// to the instruction that last wrote it
+inline void Simulation::add_data_stall(int reg, StallCause cause, int cycles) {
+    add_stall(cause, cycles);
+    if (reg < NUM_INT_REGS) {
+        perf_counters.data_stalls_by_register[reg] += cycles;
+    }
+    if (row_profile.data_count < 2) {
+        DataStall& d = row_profile.data[row_profile.data_count++];
+        d.producer_pc = writer_pc[reg];
+        d.reg = (uint8_t)reg;
+        d.cause = (uint8_t)cause;
+        d.cycles = cycles;
+    }
+}
+
+// Earliest cycle instruction i may enter stage in wide mode: not before
+// the instruction ahead of it, and not while issue_width older ones are
+// still in the stage. A squashed instruction leaves after its last stage.
+inline int Simulation::stage_free_cycle(size_t i, Stage stage) const {
+    int cycle = 0;
+    if (i > 0 && stage <= timeline.last_stage(i - 1)) {
+        cycle = timeline.stage_cycle(i - 1, stage);
+    }
+    if (i >= config.issue_width) {
+        size_t j = i - config.issue_width;
+        Stage next = (Stage)(stage + 1);
+        int leaves = next < NUM_STAGES && next <= timeline.last_stage(j) ? timeline.stage_cycle(j, next)
+                                                                         : timeline.end_cycle(j) + 1;
+        cycle = std::max(cycle, leaves);
+    }
+    return cycle;
+}
+
+// Move current_cycle up to the first cycle from which unit has room for
+// `cycles` cycles in a row, and claim them.
+inline void Simulation::claim_unit(Unit unit, int cycles) {
+    int free = 0;
+    while (free < cycles) {
+        if (units.used(current_cycle + free, unit) < unit_limits[unit]) {
+            free += 1;
+        } else {
+            current_cycle += free + 1;
+            free = 0;
+        }
+    }
+    for (int k = 0; k < cycles; ++k) {
+        units.take(current_cycle + k, unit);
+    }
+}
+
+// Move instruction i up to the first cycle it can enter stage, with a free
+// unit if it needs one, and claim that unit for unit_cycles cycles.
+// Returns the cycles waited.
+inline int Simulation::wait_for_slot(size_t i, Stage stage, Unit unit, int unit_cycles) {
+    int start = current_cycle;
+    current_cycle = std::max(current_cycle, stage_free_cycle(i, stage));
+    if (unit != NUM_UNITS) {
+        claim_unit(unit, unit_cycles);
+    }
+    return current_cycle - start;
+}
+
+// Cycle instruction row would be fetched in if nothing else held it up
+inline int Simulation::next_fetch_cycle(size_t row) const {
+    if (config.issue_width > 1) {
+        return std::max(std::max(cycle_of_prev_IF, fetch_floor), stage_free_cycle(row, STAGE_IF));
+    }
+    int cycle = cycle_of_prev_IF + 1;
+    while (row > 0 && timeline.is_stalled(row - 1, cycle)) {
+        cycle += 1;
+    }
+    return cycle;
+}
+
+// Timeline slots kept in ring mode: wide mode looks back issue_width rows,
+// the out-of-order backend a whole ROB
+inline size_t Simulation::ring_capacity() const {
+    size_t needed = 2 * config.issue_width;
+    if (config.ooo.enabled) {
+        needed = std::max(needed, (size_t)config.ooo.rob_size + 1);
+    }
+    size_t capacity = STREAM_WINDOW;
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    return capacity;
+}
+
+inline bool Simulation::in_text(uint32_t pc) const {
+    return program->contains(pc);
+}
+
+// Add row i for an instruction word (the slot already exists in ring mode).
+inline void Simulation::start_row(size_t i, uint32_t word) {
+    if (config.keeps_timeline()) {
+        timeline.append();
+        executed_words.push_back(word);
+    }
+    (void)i;
+}
+
+inline void Simulation::finish_row(size_t i, uint32_t word, const InstructionInfo& inst) {
+    if (config.mode == OUTPUT_STREAM) {
+        print_stream_row(word, i);
+    }
+    account_row(i, word, inst);
+}
+
+// Run one instruction through the pipeline. Only instruction i-1 (the
+// last issue_width in wide mode) and the scoreboard are consulted, so
+// callers may reuse old timeline slots.
+template <class Policy>
+void Simulation::issue(size_t i, const InstructionInfo& inst, const AccessInfo& access) {
+    row_profile = RowProfile();
+    row_profile.pc = access.pc;
+    if (config.ooo.enabled) {
+        issue_ooo(i, inst, access);
+    } else if (config.issue_width > 1) {
+        issue_wide<Policy>(i, inst, access);
+    } else {
+        issue_scalar<Policy>(i, inst, access);
+    }
+    if (has_output_register(inst)) {
+        writer_pc[inst.rd] = access.pc;
+    }
+}
+
+// Scalar version of issue(): one instruction per stage
+template <class Policy>
+void Simulation::issue_scalar(size_t i, const InstructionInfo& inst, const AccessInfo& access) {
+    current_cycle = cycle_of_prev_IF + 1;
+
+    // Waiting to be fetched is not a stall of this instruction
+    wait_for_previous(i);
+    IF(i);
+    // A miss holds the instruction in IF, shown as stall cycles
+    if (icache.enabled() && !icache.access(access.pc)) {
+        current_cycle += config.memory_latency;
+        add_stall(STALL_ICACHE, config.memory_latency);
+        row_profile.icache_miss = true;
+    }
+
+    add_stall(STALL_STRUCTURAL, wait_for_previous(i));
+    ID(i);
+
+    // Operands needed in EXE (a store's rs2 is checked here, rs1 before MEM)
+    if (inst.type == OpClass::STORE) {
+        wait_for_register(inst.rs2);
+    } else {
+        if (reads_rs1(inst)) {
+            wait_for_register(inst.rs1);
+        }
+        if (reads_rs2(inst)) {
+            wait_for_register(inst.rs2);
+        }
+    }
+    if (Policy::stage_interlock) {
+        add_stall(STALL_STRUCTURAL, wait_for_previous(i));
+    }
+    // A multi-cycle instruction ahead may still be holding EXE
+    if (current_cycle < exe_free) {
+        add_stall(STALL_STRUCTURAL, exe_free - current_cycle);
+        current_cycle = exe_free;
+    }
+    int latency = config.latency[inst.type];
+    Policy::on_exe(register_busy, inst, current_cycle + latency - 1);
+    EXE(i);
+    current_cycle += latency - 1;
+    add_stall(STALL_EXECUTE, latency - 1);
+    exe_free = current_cycle;
+
+    if (inst.type == OpClass::STORE) {
+        wait_for_register(inst.rs1);
+    }
+    if (Policy::stage_interlock) {
+        add_stall(STALL_STRUCTURAL, wait_for_previous(i));
+    }
+    // Cycles the access takes beyond the MEM cycle itself. A loaded value
+    // is only ready once they are over.
+    int mem_extra = 0;
+    if (access.has_data_addr && dcache.enabled() && !dcache.access(access.data_addr)) {
+        mem_extra += config.memory_latency;
+        add_stall(STALL_DCACHE, config.memory_latency);
+        row_profile.dcache_miss = true;
+    }
+    if (inst.type == OpClass::LOAD) {
+        mem_extra += config.load_latency;
+        add_stall(STALL_LOAD_LATENCY, config.load_latency);
+    }
+    Policy::on_mem(register_busy, inst, current_cycle + mem_extra);
+    MEM(i);
+    current_cycle += mem_extra;
+
+    if (Policy::stage_interlock) {
+        add_stall(STALL_STRUCTURAL, wait_for_previous(i));
+    }
+    timeline.enter(i, STAGE_WB, current_cycle);
+    Policy::on_wb(register_busy, inst, current_cycle);
+    if (has_output_register(inst)) {
+        register_busy.set_producer(inst.rd, inst.type);
+    }
+}
+
+// Wide version of issue(). Every stage is entered in program order, by up
+// to issue_width instructions at once; ALU and branch instructions also
+// need a free unit in EXE (for all their cycles if it is not pipelined),
+// loads and stores a memory port in MEM. Operands
+// are checked against all older instructions through the scoreboard, so a
+// dependence inside a fetch group stalls just like any other.
+template <class Policy>
+void Simulation::issue_wide(size_t i, const InstructionInfo& inst, const AccessInfo& access) {
+    current_cycle = std::max(cycle_of_prev_IF, fetch_floor);
+    wait_for_slot(i, STAGE_IF);
+    IF(i);
+    if (icache.enabled() && !icache.access(access.pc)) {
+        current_cycle += config.memory_latency;
+        add_stall(STALL_ICACHE, config.memory_latency);
+        row_profile.icache_miss = true;
+    }
+
+    add_stall(STALL_STRUCTURAL, wait_for_slot(i, STAGE_ID));
+    ID(i);
+
+    if (inst.type == OpClass::STORE) {
+        wait_for_register(inst.rs2);
+    } else {
+        if (reads_rs1(inst)) {
+            wait_for_register(inst.rs1);
+        }
+        if (reads_rs2(inst)) {
+            wait_for_register(inst.rs2);
+        }
+    }
+    Unit unit = unit_for(inst);
+    int latency = config.latency[inst.type];
+    add_stall(STALL_STRUCTURAL, wait_for_slot(i, STAGE_EXE, unit == UNIT_MEM ? NUM_UNITS : unit,
+                                              is_pipelined(inst.type) ? 1 : latency));
+    Policy::on_exe(register_busy, inst, current_cycle + latency - 1);
+    EXE(i);
+    current_cycle += latency - 1;
+    add_stall(STALL_EXECUTE, latency - 1);
+
+    if (inst.type == OpClass::STORE) {
+        wait_for_register(inst.rs1);
+    }
+    add_stall(STALL_STRUCTURAL, wait_for_slot(i, STAGE_MEM, unit == UNIT_MEM ? UNIT_MEM : NUM_UNITS));
+    int mem_extra = 0;
+    if (access.has_data_addr && dcache.enabled() && !dcache.access(access.data_addr)) {
+        mem_extra += config.memory_latency;
+        add_stall(STALL_DCACHE, config.memory_latency);
+        row_profile.dcache_miss = true;
+    }
+    if (inst.type == OpClass::LOAD) {
+        mem_extra += config.load_latency;
+        add_stall(STALL_LOAD_LATENCY, config.load_latency);
+    }
+    Policy::on_mem(register_busy, inst, current_cycle + mem_extra);
+    MEM(i);
+    current_cycle += mem_extra;
+
+    add_stall(STALL_STRUCTURAL, wait_for_slot(i, STAGE_WB));
+    timeline.enter(i, STAGE_WB, current_cycle);
+    Policy::on_wb(register_busy, inst, current_cycle);
+    if (has_output_register(inst)) {
+        register_busy.set_producer(inst.rd, inst.type);
+    }
+}
+
+template <class Policy>
+void Simulation::pipeline() {
+    const std::vector<InstructionInfo>& insts = program->insts;
+    if (config.mode == OUTPUT_STREAM) {
+        print_stream_header();
+    }
+    for (size_t i = 0; i < insts.size(); ++i) {
+        AccessInfo access;
+        access.pc = program->pc_of(i);
+        issue<Policy>(i, insts[i], access);
+        finish_row(i, program->words()[i], insts[i]);
+    }
+}
+
+// pipeline() for --incremental. The old and new words are diffed into
+// runs of equal rows. Inside a run, once the pipeline state matches an old
+// snapshot (shifted by some number of cycles), the old rows are copied
+// with that shift up to the last snapshot of the run, and simulation goes
+// on from that snapshot. Only the rows around each edit are simulated.
+template <class Policy>
+void Simulation::incremental_pipeline() {
+    const std::vector<InstructionInfo>& insts = program->insts;
+    const uint32_t* words = program->words();
+    size_t n = insts.size();
+
+    IncrementalState old;
+    std::string reason;
+    bool reuse = old.load(config.incremental_path, reason);
+    IncrementalState next;
+    next.fingerprint = timing_fingerprint(Policy::kind);
+    next.words.assign(words, words + n);
+    if (reuse && old.fingerprint != next.fingerprint) {
+        reuse = false;
+        reason = "the timing options changed";
+    }
+    std::vector<MatchingBlock> blocks;
+    if (reuse) {
+        blocks = matching_blocks(old.words.data(), old.words.size(), words, n, INCREMENTAL_MAX_EDITS);
+    }
+    size_t old_n = old.words.size();
+    // Index of the first old snapshot at or after an old row
+    auto snapshot_from = [&old](size_t row) {
+        return (size_t)(std::lower_bound(old.snapshots.begin(), old.snapshots.end(), row,
+                                         [](const PipelineSnapshot& s, size_t r) { return s.row < r; }) -
+                        old.snapshots.begin());
+    };
+
+    if (config.mode == OUTPUT_STREAM) {
+        print_stream_header();
+    }
+    size_t block = 0;
+    size_t simulated = 0;
+    size_t i = 0;
+    while (true) {
+        while (block < blocks.size() && blocks[block].now_start + blocks[block].length <= i) {
+            block += 1;
+        }
+        // Row i is old row j, and the old run has a snapshot there
+        bool aligned = false;
+        size_t j = 0;
+        size_t at = 0;
+        if (block < blocks.size() && blocks[block].now_start <= i) {
+            j = blocks[block].old_start + (i - blocks[block].now_start);
+            at = snapshot_from(j);
+            aligned = at < old.snapshots.size() && old.snapshots[at].row == j;
+        }
+        if (aligned) {
+            const MatchingBlock& run = blocks[block];
+            size_t old_end = run.old_start + run.length;
+            bool tail = old_end == old_n && run.now_start + run.length == n;
+            // Copy up to the last old snapshot inside the run, or to the end
+            size_t to = snapshot_from(old_end + 1);
+            size_t stop = tail ? old_n : old.snapshots[to - 1].row;
+            if (stop > j) {
+                const PipelineSnapshot& then = old.snapshots[at];
+                PipelineSnapshot now = take_snapshot(i);
+                bool same = same_pipeline_state(now, then);
+                if (same && i > 0) {
+                    const TimelineEntry& prev = timeline.entry(i - 1);
+                    const TimelineEntry& old_prev = old.rows[j - 1];
+                    same = memcmp(prev.stalls, old_prev.stalls, sizeof(prev.stalls)) == 0;
+                }
+                if (same) {
+                    int shift = cycle_of_prev_IF - then.cycle_of_prev_IF;
+                    ptrdiff_t moved = (ptrdiff_t)i - (ptrdiff_t)j;
+                    for (size_t k = j; k < stop; ++k) {
+                        TimelineEntry e = old.rows[k];
+                        e.if_cycle += shift;
+                        timeline.set_entry(k + moved, e);
+                        if (config.mode == OUTPUT_STREAM) {
+                            print_stream_row(words[k + moved], k + moved);
+                        }
+                    }
+                    size_t last = tail ? old.snapshots.size() : to;
+                    PipelineSnapshot resume;
+                    for (size_t k = at; k < last; ++k) {
+                        PipelineSnapshot s = old.snapshots[k];
+                        s.shift(shift);
+                        s.row += moved;
+                        s.counters = rebase_counters(s.counters, then.counters, shift);
+                        next.snapshots.push_back(s);
+                        resume = s;
+                    }
+                    if (tail) {
+                        perf_counters = rebase_counters(old.counters, then.counters, shift);
+                        i = n;
+                        break;
+                    }
+                    restore_snapshot(resume);
+                    i = stop + moved;
+                    continue;
+                }
+            }
+        }
+        if (i == n) {
+            break;
+        }
+        if (next.snapshots.empty() || i - next.snapshots.back().row >= INCREMENTAL_INTERVAL) {
+            next.snapshots.push_back(take_snapshot(i));
+        }
+        AccessInfo access;
+        access.pc = program->pc_of(i);
+        issue<Policy>(i, insts[i], access);
+        finish_row(i, words[i], insts[i]);
+        simulated += 1;
+        i += 1;
+    }
+
+    if (reuse) {
+        size_t edits = blocks.size() + 1;
+        if (!blocks.empty() && blocks.front().now_start == 0 && blocks.front().old_start == 0) {
+            edits -= 1;
+        }
+        if (!blocks.empty() && blocks.back().now_start + blocks.back().length == n &&
+            blocks.back().old_start + blocks.back().length == old_n) {
+            edits -= 1;
+        }
+        incremental_note = "Incremental: simulated " + std::to_string(simulated) + " of " + std::to_string(n) +
+                           " rows around " + std::to_string(edits) + (edits == 1 ? " edit" : " edits") +
+                           ", reused the rest";
+    } else {
+        incremental_note = "Incremental: simulated all " + std::to_string(n) + " rows (" + reason + ")";
+    }
+    next.rows.resize(n);
+    for (size_t k = 0; k < n; ++k) {
+        next.rows[k] = timeline.entry(k);
+    }
+    next.counters = perf_counters;
+    if (!next.save(config.incremental_path)) {
+        std::cerr << "Cannot write " << config.incremental_path << std::endl;
+    }
+}
+
+// Simulate while reading, keeping only a small window of the timeline.
+// In OUTPUT_STREAM mode each instruction's stage cycles are printed as
+// soon as it reaches WB.
+template <class Policy>
+void Simulation::stream_pipeline(TraceStream& in) {
+    timeline.resize_ring(ring_capacity());
+
+    uint32_t word;
+    size_t i = 0;
+
+    if (config.mode == OUTPUT_STREAM) {
+        print_stream_header();
+    }
+    while (in.next(word)) {
+        InstructionInfo inst = decode_word(word);
+        AccessInfo access;
+        access.pc = TEXT_BASE + 4 * i;
+        issue<Policy>(i, inst, access);
+        finish_row(i, word, inst);
+        i += 1;
+    }
+}
+
+// After a mispredicted control instruction, fetch continues down the
+// predicted path until the instruction resolves in EXE at resolve_cycle.
+// Those instructions are added as squashed rows; they leave no trace in
+// the scoreboard or the counters, apart from the squash count and the
+// fetch cycles lost. Returns the next free row.
+template <class Policy>
+size_t Simulation::fetch_wrong_path(size_t row, uint32_t pc, int resolve_cycle) {
+    Scoreboard saved = register_busy;
+    PerfCounters saved_counters = perf_counters;
+    std::array<uint32_t, Scoreboard::NUM_REGS> saved_writers = writer_pc;
+    int saved_exe_free = exe_free;
+    size_t first_row = row;
+    units.start_logging();
+
+    // Without the misprediction the next fetch would have been at
+    int next_fetch = next_fetch_cycle(row);
+
+    while (in_text(pc)) {
+        if (next_fetch_cycle(row) > resolve_cycle) {
+            break;
+        }
+        size_t index = program->index_of(pc);
+        uint32_t word = program->words()[index];
+        start_row(row, word);
+        AccessInfo access;
+        access.pc = pc;
+        issue<Policy>(row, program->insts[index], access);
+        timeline.squash(row, resolve_cycle);
+        finish_row(row, word, program->insts[index]);
+        row += 1;
+        pc += program->insts[index].size;
+    }
+
+    register_busy = saved;
+    writer_pc = saved_writers;
+    exe_free = saved_exe_free;
+    units.release_after(resolve_cycle);
+    perf_counters = saved_counters;
+    perf_counters.squashed += row - first_row;
+    if (resolve_cycle + 1 > next_fetch) {
+        perf_counters.control_cycles += resolve_cycle + 1 - next_fetch;
+    }
+    // The correct path is fetched the cycle after the branch resolves
+    if (cycle_of_prev_IF < resolve_cycle) {
+        cycle_of_prev_IF = resolve_cycle;
+    }
+    fetch_floor = std::max(fetch_floor, resolve_cycle + 1);
+    return row;
+}
+
+// Issue the instruction at cpu.pc, execute it, and handle a
+// misprediction. Returns the next free row.
+template <class Policy>
+size_t Simulation::execute_one(size_t row) {
+    uint32_t pc = cpu.pc;
+    size_t index = program->index_of(pc);
+    const InstructionInfo& inst = program->insts[index];
+    uint32_t word = program->words()[index];
+
+    AccessInfo access;
+    access.pc = pc;
+    if (inst.type == OpClass::LOAD || inst.type == OpClass::STORE) {
+        access.data_addr = cpu.regs[inst.rs1] + inst.imm;
+        access.has_data_addr = true;
+    }
+
+    start_row(row, word);
+    issue<Policy>(row, inst, access);
+    cpu.step(inst);
+    finish_row(row, word, inst);
+
+    if (is_control(inst)) {
+        uint32_t predicted = predictor.config().kind == PredictorKind::PERFECT
+                                 ? cpu.pc : predictor.predict(pc, inst);
+        predictor.update(pc, inst, predicted, cpu.pc);
+        // A taken prediction ends the fetch group (only matters when wide)
+        if (predicted != pc + inst.size) {
+            fetch_floor = timeline.stage_cycle(row, STAGE_IF) + 1;
+        }
+        if (predicted != cpu.pc) {
+            uint64_t lost = perf_counters.control_cycles;
+            size_t next = row + 1;
+            if (config.ooo.enabled) {
+                ooo_redirect(row);
+            } else {
+                int resolve_cycle = timeline.stage_cycle(row, STAGE_EXE);
+                next = fetch_wrong_path<Policy>(row + 1, predicted, resolve_cycle);
+            }
+            if (profile.enabled()) {
+                profile[index].mispredicts += 1;
+                profile[index].control_cycles += perf_counters.control_cycles - lost;
+            }
+            return next;
+        }
+    }
+    return row + 1;
+}
+
+// Functional mode: run the program from its entry point (or the restored
+// checkpoint), executing each instruction, and feed the dynamic
+// instruction stream (not the static listing) through the pipeline. Fetch
+// follows the branch predictor, and mispredictions are flushed when the
+// control instruction reaches EXE. Stops when pc leaves the program text,
+// the program exits, or after max_instructions. Returns the number of
+// instructions retired.
+template <class Policy>
+size_t Simulation::execute_pipeline() {
+    if (config.keeps_timeline()) {
+        timeline.resize(0);
+        executed_words.clear();
+    } else {
+        timeline.resize_ring(ring_capacity());
+    }
+    if (config.mode == OUTPUT_STREAM) {
+        print_stream_header();
+    }
+
+    size_t count = 0;
+    size_t row = 0;
+    while (count < config.max_instructions && !cpu.halted && in_text(cpu.pc)) {
+        row = execute_one<Policy>(row);
+        count += 1;
+        position += 1;
+        maybe_checkpoint();
+    }
+    return count;
+}
+
+// Sampled run over the executed program (--execute) or the trace listing.
+// Between sample windows instructions are only executed, or just fetched
+// for a listing, so the pipeline starts each window's warmup stale.
+// Returns the number of instructions covered.
+template <class Policy>
+size_t Simulation::sampled_pipeline() {
+    timeline.resize_ring(ring_capacity());
+    const SampleConfig& sampling = config.sampling;
+    uint64_t skipped = sampling.period - sampling.warmup - sampling.size;
+
+    size_t count = 0;
+    size_t row = 0;
+    uint64_t window_start = 0;
+    while (config.execute ? count < config.max_instructions && !cpu.halted && in_text(cpu.pc)
+                          : position < program->size()) {
+        uint64_t phase = count % sampling.period;
+        if (phase < skipped) {
+            if (config.execute) {
+                fast_forward_one();
+            } else if (icache.enabled()) {
+                icache.access(program->pc_of(position));
+            }
+        } else {
+            if (phase == skipped + sampling.warmup) {
+                window_start = perf_counters.cycles;
+            }
+            if (config.execute) {
+                row = execute_one<Policy>(row);
+            } else {
+                AccessInfo access;
+                access.pc = program->pc_of(position);
+                issue<Policy>(row, program->insts[position], access);
+                account_row(row, program->words()[position], program->insts[position]);
+                row += 1;
+            }
+            if (phase == sampling.period - 1) {
+                sample_cpis.push_back((double)(perf_counters.cycles - window_start) / sampling.size);
+            }
+        }
+        count += 1;
+        position += 1;
+        maybe_checkpoint();
+    }
+    return count;
+}
+
+template <class Policy>
+bool Simulation::run(const std::string& input_path) {
+    if (config.execute || config.keeps_timeline() || config.sampling.enabled() || config.critical_path ||
+        config.profiling() || !config.incremental_path.empty() || is_elf_file(input_path)) {
+        std::shared_ptr<Program> loaded(new Program);
+        if (!loaded->load(input_path, error)) {
+            return false;
+        }
+        return run<Policy>(std::shared_ptr<const Program>(loaded));
+    }
+
+    TraceStream in;
+    if (!in.open(input_path)) {
+        error = in.error();
+        return false;
+    }
+    if (!size_unit_table() || !open_events()) {
+        return false;
+    }
+    stream_pipeline<Policy>(in);
+    if (config.mode != OUTPUT_NONE) {
+        print_counters(std::cout, perf_counters);
+        print_cache_stats();
+    }
+    return close_events();
+}
+
+template <class Policy>
+bool Simulation::run(std::shared_ptr<const Program> loaded) {
+    program = loaded;
+    profile.reset(config.profiling() ? program->size() : 0);
+    if (!size_unit_table() || !open_events()) {
+        return false;
+    }
+    bool ok = simulate<Policy>() && report_profile();
+    return close_events() && ok;
+}
+
+template <class Policy>
+bool Simulation::simulate() {
+    bool quiet = config.mode == OUTPUT_NONE;
+
+    if (!config.execute && (config.checkpoint_at > 0 || !config.restore_path.empty())) {
+        error = "Checkpoints need --execute";
+        return false;
+    }
+
+    if (!config.incremental_path.empty() &&
+        (config.execute || config.sampling.enabled() || config.issue_width > 1 || config.ooo.enabled ||
+         config.icache.enabled() || config.profiling() || events)) {
+        error = "--incremental only works on a trace listing with the scalar pipeline "
+                "(not with --execute, --sample, --width, --ooo, --icache, --profile or --events)";
+        return false;
+    }
+
+    if (config.execute) {
+        reset_cpu();
+        if (!setup_inputs()) {
+            return false;
+        }
+        if (!config.restore_path.empty() && !load_checkpoint(config.restore_path)) {
+            return false;
+        }
+    }
+
+    if (config.critical_path) {
+        analyze_dependencies();
+        return true;
+    }
+
+    if (config.sampling.enabled()) {
+        size_t executed = sampled_pipeline<Policy>();
+        if (quiet) {
+            return true;
+        }
+        print_sample_report(executed);
+        if (config.execute) {
+            print_halt_state(executed);
+            print_predictor_stats();
+        }
+        print_cache_stats();
+        return true;
+    }
+
+    if (config.execute) {
+        size_t executed = execute_pipeline<Policy>();
+        if (quiet) {
+            return true;
+        }
+        if (config.mode == OUTPUT_TABLE) {
+            print_table(executed_words.data(), executed_words.size());
+        } else {
+            print_counters(std::cout, perf_counters);
+        }
+        print_halt_state(executed);
+        print_predictor_stats();
+        print_cache_stats();
+        return true;
+    }
+
+    bool incremental = !config.incremental_path.empty();
+    if (config.keeps_timeline() || incremental) {
+        timeline.resize(program->size());
+    } else {
+        timeline.resize_ring(ring_capacity());
+    }
+    if (incremental) {
+        incremental_pipeline<Policy>();
+    } else {
+        pipeline<Policy>();
+    }
+    if (config.mode == OUTPUT_TABLE) {
+        print_table(program->words(), program->size());
+    } else if (!quiet) {
+        print_counters(std::cout, perf_counters);
+    }
+    if (!quiet) {
+        print_cache_stats();
+        if (incremental) {
+            std::cout << incremental_note << std::endl;
+        }
+    }
+    return true;
+}
+
+// Run with a policy picked at run time
+inline bool run_with_policy(Simulation& sim, PolicyKind kind, std::shared_ptr<const Program> program) {
+    switch (kind) {
+        case PolicyKind::FORWARDING: return sim.run<ForwardingPolicy>(program);
+        case PolicyKind::NONE: return sim.run<NoForwardingPolicy>(program);
+        case PolicyKind::BYPASS: return sim.run<BypassPolicy>(program);
+        default: return sim.run<AluBypassPolicy>(program);
+    }
+}
+
+// Shared main() for the simulator binaries.
+template <class Policy>
+int simulator_main(int argc, char* argv[]) {
+    SimConfig config;
+    std::string json_path;
+    std::string batch_source;
+    unsigned jobs = 0;
+    bool serve = false;
+    ServerOptions server;
+    std::string input_path = "input.txt";
+    for (int a = 1; a < argc; ++a) {
+        std::string arg = argv[a];
+        if (arg == "--stream") {
+            config.mode = OUTPUT_STREAM;
+        } else if (arg == "--stats") {
+            config.mode = OUTPUT_STATS;
+        } else if (arg == "--json" && a + 1 < argc) {
+            json_path = argv[++a];
+        } else if (arg == "--batch" && a + 1 < argc) {
+            batch_source = argv[++a];
+        } else if (arg == "--jobs" && a + 1 < argc) {
+            uint64_t count;
+            if (!parse_count(argv[++a], 0, MAX_JOBS, count)) {
+                std::cerr << "Bad job count " << argv[a] << " (0 to " << MAX_JOBS << ")" << std::endl;
+                return 1;
+            }
+            jobs = (unsigned)count;
+        } else if (arg == "--serve" && a + 1 < argc) {
+            serve = true;
+            server.socket_path = argv[++a];
+        } else if (arg == "--program-cache" && a + 1 < argc) {
+            uint64_t size;
+            if (!parse_count(argv[++a], 1, MAX_PROGRAM_CACHE, size)) {
+                std::cerr << "Bad program cache size " << argv[a] << " (1 to " << MAX_PROGRAM_CACHE << ")"
+                          << std::endl;
+                return 1;
+            }
+            server.program_cache = size;
+        } else {
+            int handled = parse_config_option(argc, argv, a, config);
+            if (handled < 0) {
+                return 1;
+            }
+            if (handled == 0) {
+                input_path = arg;
+            }
+        }
+    }
+
+    const char* shared = shared_output_option(config);
+    if (shared && (serve || !batch_source.empty())) {
+        std::cerr << shared << " cannot be used with " << (serve ? "--serve" : "--batch")
+                  << ": every run would write the same file" << std::endl;
+        return 1;
+    }
+
+    if (serve) {
+        server.jobs = jobs;
+        return run_server(Policy::kind, config, server);
+    }
+
+    if (!batch_source.empty()) {
+        std::vector<std::string> paths;
+        std::string error;
+        if (!list_batch_inputs(batch_source, paths, error)) {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        config.mode = OUTPUT_NONE;
+        std::vector<BatchResult> results = run_batch(paths, jobs, [&config](BatchResult& result) {
+            std::unique_ptr<Simulation> sim(new Simulation(config));
+            result.ok = sim->run<Policy>(result.path);
+            result.error = sim->error;
+            result.counters = sim->counters();
+        });
+        return write_batch_results(json_path.empty() ? "-" : json_path, results) ? 0 : 1;
+    }
+
+    std::unique_ptr<Simulation> sim(new Simulation(config));
+    if (!sim->run<Policy>(input_path)) {
+        std::cerr << sim->error << std::endl;
+        return 1;
+    }
+    return write_counters_file(json_path, sim->counters()) ? 0 : 1;
+}
+
+#endif
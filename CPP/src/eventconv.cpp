@@ -0,0 +1,164 @@
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "decode.h"
+#include "events.h"
+
+using namespace std;
+
+// Gem5 ticks per cycle in O3PipeView output; Konata only needs the ratio
+static const uint64_t TICKS_PER_CYCLE = 1000;
+
+static const char* const stage_names[NUM_STAGES] = {"IF", "ID", "EXE", "MEM", "WB"};
+
+// Cycle row entered each stage, up to the last one it reached
+static int stage_cycles(const EventRow& row, int cycles[NUM_STAGES]) {
+    int cycle = row.entry.if_cycle;
+    cycles[0] = cycle;
+    for (int s = 0; s < NUM_STAGES - 1; ++s) {
+        if (row.entry.stalls[s] == SQUASHED) {
+            return s;
+        }
+        cycle += 1 + row.entry.stalls[s];
+        cycles[s + 1] = cycle;
+    }
+    return NUM_STAGES - 1;
+}
+
+// "00550023 STORE", and the stall causes if any
+static string label(const EventRow& row, bool with_stalls) {
+    char text[16];
+    snprintf(text, sizeof(text), "%08x ", row.word);
+    string result = text + string(op_class_name(decode_word(row.word).type));
+    const char* separator = " [";
+    for (int c = 0; with_stalls && c < NUM_STALL_CAUSES; ++c) {
+        if (row.stalls[c] > 0) {
+            result += separator + string(stall_cause_name((StallCause)c)) + " " + to_string(row.stalls[c]);
+            separator = ", ";
+        }
+    }
+    if (separator[0] == ',') {
+        result += "]";
+    }
+    return result;
+}
+
+// gem5's O3PipeView text, which Konata opens. The five stages map to
+// fetch, decode (also rename and dispatch), issue, complete and retire;
+// stages a squashed row never reached are 0, which marks it flushed.
+static bool write_o3(EventReader& in, FILE* out) {
+    EventRow row;
+    while (in.next(row)) {
+        int cycles[NUM_STAGES];
+        int last = stage_cycles(row, cycles);
+        uint64_t tick[NUM_STAGES];
+        for (int s = 0; s < NUM_STAGES; ++s) {
+            tick[s] = s <= last ? cycles[s] * TICKS_PER_CYCLE : 0;
+        }
+        fprintf(out, "O3PipeView:fetch:%llu:0x%08x:0:%llu:%s\n", (unsigned long long)tick[STAGE_IF], row.pc,
+                (unsigned long long)row.seq + 1, label(row, true).c_str());
+        fprintf(out, "O3PipeView:decode:%llu\n", (unsigned long long)tick[STAGE_ID]);
+        fprintf(out, "O3PipeView:rename:%llu\n", (unsigned long long)tick[STAGE_ID]);
+        fprintf(out, "O3PipeView:dispatch:%llu\n", (unsigned long long)tick[STAGE_ID]);
+        fprintf(out, "O3PipeView:issue:%llu\n", (unsigned long long)tick[STAGE_EXE]);
+        fprintf(out, "O3PipeView:complete:%llu\n", (unsigned long long)tick[STAGE_MEM]);
+        fprintf(out, "O3PipeView:retire:%llu:store:0\n", (unsigned long long)tick[STAGE_WB]);
+    }
+    return in.error().empty();
+}
+
+// Chrome trace-event JSON (chrome://tracing, Perfetto) with one cycle per
+// microsecond. Each row is a slice, with its stages as slices inside it,
+// on the first track free since the row's last cycle.
+static bool write_chrome(EventReader& in, FILE* out) {
+    fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+    vector<int> track_end;
+    EventRow row;
+    const char* separator = "";
+    while (in.next(row)) {
+        int cycles[NUM_STAGES];
+        int last = stage_cycles(row, cycles);
+        int end = cycles[last] + 1;
+        size_t track = 0;
+        while (track < track_end.size() && track_end[track] > cycles[0]) {
+            track += 1;
+        }
+        if (track == track_end.size()) {
+            track_end.push_back(0);
+        }
+        track_end[track] = end;
+
+        bool squashed = last != STAGE_WB;
+        fprintf(out, "%s{\"name\": \"%s%s\", \"cat\": \"%s\", \"ph\": \"X\", \"ts\": %d, \"dur\": %d, "
+                     "\"pid\": 1, \"tid\": %zu, \"args\": {\"seq\": %llu, \"pc\": \"0x%08x\"",
+                separator, label(row, false).c_str(), squashed ? " (squashed)" : "",
+                squashed ? "squashed" : "instruction", cycles[0], end - cycles[0], track,
+                (unsigned long long)row.seq, row.pc);
+        for (int c = 0; c < NUM_STALL_CAUSES; ++c) {
+            if (row.stalls[c] > 0) {
+                fprintf(out, ", \"%s\": %u", stall_cause_name((StallCause)c), row.stalls[c]);
+            }
+        }
+        fprintf(out, "}}");
+        separator = ",\n";
+        for (int s = 0; s <= last; ++s) {
+            int length = s < last ? cycles[s + 1] - cycles[s] : 1;
+            fprintf(out, ",\n{\"name\": \"%s\", \"cat\": \"stage\", \"ph\": \"X\", \"ts\": %d, \"dur\": %d, "
+                         "\"pid\": 1, \"tid\": %zu, \"args\": {\"stall\": %d}}",
+                    stage_names[s], cycles[s], length, track, length - 1);
+        }
+    }
+    for (size_t track = 0; track < track_end.size(); ++track) {
+        fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, "
+                     "\"args\": {\"name\": \"slot %zu\"}}",
+                separator, track, track);
+        separator = ",\n";
+    }
+    fprintf(out, "\n]}\n");
+    return in.error().empty();
+}
+
+// Convert an event log written by --events for a pipeline viewer
+int main(int argc, char* argv[]) {
+    string format;
+    string paths[2];
+    int npaths = 0;
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--konata" || arg == "--chrome") {
+            format = arg.substr(2);
+        } else if (npaths < 2) {
+            paths[npaths++] = arg;
+        } else {
+            npaths = 3;
+        }
+    }
+    if (npaths != 2 || format.empty()) {
+        cerr << "Usage: eventconv --konata|--chrome <event_file> <output_file>" << endl;
+        return 1;
+    }
+
+    EventReader in;
+    if (!in.open(paths[0])) {
+        cerr << in.error() << endl;
+        return 1;
+    }
+    FILE* out = paths[1] == "-" ? stdout : fopen(paths[1].c_str(), "w");
+    if (!out) {
+        cerr << "Error writing " << paths[1] << endl;
+        return 1;
+    }
+    bool ok = format == "konata" ? write_o3(in, out) : write_chrome(in, out);
+    bool written = (out == stdout ? fflush(out) : fclose(out)) == 0;
+    if (!ok) {
+        cerr << paths[0] << ": " << in.error() << endl;
+        return 1;
+    }
+    if (!written) {
+        cerr << "Error writing " << paths[1] << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+#include "events.h"
+
+#include <chrono>
+#include <cstring>
+
+using namespace std;
+
+static uint8_t* put_varint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+static uint64_t zigzag(int64_t value) {
+    return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+bool EventLog::open(const string& path, string& error) {
+    close();
+    file = fopen(path.c_str(), "wb");
+    if (!file) {
+        error = "Cannot write " + path;
+        return false;
+    }
+    uint8_t header[8];
+    memcpy(header, EVENT_MAGIC, 4);
+    for (int k = 0; k < 4; ++k) {
+        header[4 + k] = (uint8_t)(EVENT_VERSION >> (8 * k));
+    }
+    fwrite(header, 1, sizeof(header), file);
+
+    pool.reset(new Buffer[NUM_BUFFERS]);
+    for (size_t b = 1; b < NUM_BUFFERS; ++b) {
+        empty.push(&pool[b]);
+    }
+    current = &pool[0];
+    current->used = 0;
+    finishing = false;
+    failed = false;
+    prev_seq = ~(uint64_t)0;
+    prev_pc = 0;
+    prev_if = 0;
+    writer = thread(&EventLog::writer_loop, this);
+    return true;
+}
+
+void EventLog::row(uint64_t seq, uint32_t pc, uint32_t word, const TimelineEntry& entry,
+                   const uint32_t stalls[NUM_STALL_CAUSES]) {
+    if (BUFFER_SIZE - current->used < MAX_RECORD) {
+        hand_over();
+    }
+    uint8_t* start = current->bytes + current->used;
+    uint8_t* out = start + 1;
+
+    int last = NUM_STAGES - 1;
+    for (int s = 0; s < NUM_STAGES - 1; ++s) {
+        if (entry.stalls[s] == SQUASHED) {
+            last = s;
+            break;
+        }
+    }
+    uint8_t mask = 0;
+    for (int c = 0; c < NUM_STALL_CAUSES; ++c) {
+        mask |= (uint8_t)((stalls[c] != 0) << c);
+    }
+    *start = (uint8_t)last | (mask ? EVENT_HAS_STALLS : 0);
+
+    out = put_varint(out, seq - prev_seq - 1);
+    out = put_varint(out, zigzag((int64_t)pc - ((int64_t)prev_pc + 4)));
+    for (int k = 0; k < 4; ++k) {
+        *out++ = (uint8_t)(word >> (8 * k));
+    }
+    out = put_varint(out, zigzag((int64_t)entry.if_cycle - prev_if));
+    for (int s = 0; s < last; ++s) {
+        out = put_varint(out, entry.stalls[s]);
+    }
+    if (mask) {
+        *out++ = mask;
+        for (int c = 0; c < NUM_STALL_CAUSES; ++c) {
+            if (stalls[c] != 0) {
+                out = put_varint(out, stalls[c]);
+            }
+        }
+    }
+    current->used = out - current->bytes;
+    prev_seq = seq;
+    prev_pc = pc;
+    prev_if = entry.if_cycle;
+}
+
+// Pass the current buffer to the writer and take an empty one, waiting
+// for the writer if it has them all
+void EventLog::hand_over() {
+    while (!filled.push(current)) {
+        this_thread::yield();
+    }
+    while (!empty.pop(current)) {
+        this_thread::yield();
+    }
+    current->used = 0;
+}
+
+void EventLog::writer_loop() {
+    int idle = 0;
+    for (;;) {
+        // close() hands over the last buffer before it sets finishing, so
+        // once that is seen an empty queue stays empty
+        bool done = finishing.load(memory_order_acquire);
+        Buffer* buffer;
+        if (filled.pop(buffer)) {
+            if (fwrite(buffer->bytes, 1, buffer->used, file) != buffer->used) {
+                failed = true;
+            }
+            empty.push(buffer);
+            idle = 0;
+        } else if (done) {
+            return;
+        } else if (++idle < 64) {
+            this_thread::yield();
+        } else {
+            this_thread::sleep_for(chrono::microseconds(200));
+        }
+    }
+}
+
+bool EventLog::close() {
+    if (!file) {
+        return true;
+    }
+    if (current->used > 0) {
+        hand_over();
+    }
+    finishing.store(true, memory_order_release);
+    writer.join();
+    bool ok = !failed && fclose(file) == 0;
+    file = nullptr;
+    pool.reset();
+    Buffer* buffer;
+    while (empty.pop(buffer)) {
+    }
+    return ok;
+}
+
+EventReader::~EventReader() {
+    if (file) {
+        fclose(file);
+    }
+}
+
+bool EventReader::open(const string& path) {
+    file = fopen(path.c_str(), "rb");
+    if (!file) {
+        error_message = "Error opening " + path;
+        return false;
+    }
+    uint8_t header[8];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, EVENT_MAGIC, 4) != 0) {
+        error_message = path + " is not an event log";
+        return false;
+    }
+    uint32_t version = header[4] | header[5] << 8 | header[6] << 16 | (uint32_t)header[7] << 24;
+    if (version != EVENT_VERSION) {
+        error_message = path + " has event log version " + to_string(version);
+        return false;
+    }
+    return true;
+}
+
+bool EventReader::varint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        int c = getc(file);
+        if (c == EOF) {
+            return false;
+        }
+        value |= (uint64_t)(c & 0x7f) << shift;
+        if (!(c & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool EventReader::next(EventRow& row) {
+    int tag = getc(file);
+    if (tag == EOF) {
+        return false;
+    }
+    int last = tag & 0x0f;
+    uint64_t seq, pc, cycle;
+    uint8_t word[4];
+    bool ok = last < NUM_STAGES && varint(seq) && varint(pc) && fread(word, 1, 4, file) == 4 && varint(cycle);
+    row = EventRow();
+    if (ok) {
+        row.seq = first ? seq : prev.seq + 1 + seq;
+        row.pc = (uint32_t)(prev.pc + 4 + unzigzag(pc));
+        row.word = word[0] | word[1] << 8 | word[2] << 16 | (uint32_t)word[3] << 24;
+        row.entry.if_cycle = (uint32_t)(prev.entry.if_cycle + unzigzag(cycle));
+    }
+    for (int s = 0; ok && s < NUM_STAGES - 1; ++s) {
+        uint64_t stall = SQUASHED;
+        if (s < last) {
+            ok = varint(stall) && stall < SQUASHED;
+        }
+        row.entry.stalls[s] = (uint32_t)(s <= last ? stall : 0);
+    }
+    if (ok && (tag & EVENT_HAS_STALLS)) {
+        int mask = getc(file);
+        ok = mask != EOF;
+        for (int c = 0; ok && c < NUM_STALL_CAUSES; ++c) {
+            uint64_t cycles = 0;
+            if (mask & (1 << c)) {
+                ok = varint(cycles);
+            }
+            row.stalls[c] = (uint32_t)cycles;
+        }
+    }
+    if (!ok) {
+        error_message = "Truncated or corrupt event record";
+        return false;
+    }
+    prev = row;
+    first = false;
+    return true;
+}
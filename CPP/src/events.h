@@ -0,0 +1,148 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "counters.h"
+#include "timeline.h"
+
+// Event log (--events): one record per row of the timeline, written as
+// the row retires or is squashed, with the cycle it entered each stage it
+// reached and its stall cycles by cause. eventconv turns a log into
+// O3PipeView text (for Konata) or Chrome trace-event JSON.
+//
+// File format: "RVEV", a little-endian uint32 version, then records:
+//   tag      byte: last stage reached (the row was squashed unless it is
+//            WB), plus EVENT_HAS_STALLS when cause cycles follow
+//   seq      varint: row number minus the previous row's, minus one
+//   pc       varint: pc minus 4 past the previous row's pc (zigzag)
+//   word     uint32, little endian
+//   if       varint: IF cycle minus the previous row's (zigzag)
+//   stalls   one varint per stage before the last: cycles stalled there
+//   causes   if EVENT_HAS_STALLS: a byte with a bit per stall cause,
+//            then a varint of cycles for each bit set
+// Varints are 7 bits a byte, low bits first, so a typical row takes
+// about ten bytes.
+
+const char EVENT_MAGIC[4] = {'R', 'V', 'E', 'V'};
+const uint32_t EVENT_VERSION = 1;
+const uint8_t EVENT_HAS_STALLS = 0x10;
+
+// One row of the log
+struct EventRow {
+    uint64_t seq = 0;
+    uint32_t pc = 0;
+    uint32_t word = 0;
+    TimelineEntry entry = {};
+    uint32_t stalls[NUM_STALL_CAUSES] = {};
+};
+
+// Fixed-size queue between one producer and one consumer thread, with no
+// locks: each side only writes its own index.
+template <class T, size_t N>
+class SpscRing {
+public:
+    bool push(const T& value) {
+        size_t tail = tail_index.load(std::memory_order_relaxed);
+        if (tail - head_index.load(std::memory_order_acquire) == N) {
+            return false;
+        }
+        slots[tail % N] = value;
+        tail_index.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& value) {
+        size_t head = head_index.load(std::memory_order_relaxed);
+        if (head == tail_index.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[head % N];
+        head_index.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    alignas(64) std::atomic<size_t> head_index{0};
+    alignas(64) std::atomic<size_t> tail_index{0};
+    T slots[N];
+};
+
+// Writes an event log from a thread of its own. The simulation encodes
+// rows into a buffer; full buffers go to the writer thread and come back
+// empty through two SpscRings, so the simulation only waits when the
+// disk falls a whole pool of buffers behind.
+class EventLog {
+public:
+    EventLog() {}
+    ~EventLog() { close(); }
+    EventLog(const EventLog&) = delete;
+    EventLog& operator=(const EventLog&) = delete;
+
+    bool open(const std::string& path, std::string& error);
+    // Add row seq; stalls are its cycles by cause
+    void row(uint64_t seq, uint32_t pc, uint32_t word, const TimelineEntry& entry,
+             const uint32_t stalls[NUM_STALL_CAUSES]);
+    // Flush everything and stop the writer. Returns false if any write
+    // failed.
+    bool close();
+
+private:
+    static const size_t BUFFER_SIZE = 1 << 16;
+    static const size_t NUM_BUFFERS = 8;
+    // Longest record: tag, 3 varints of 10 bytes, the word, 4 stalls, a
+    // mask and the causes
+    static const size_t MAX_RECORD = 1 + 3 * 10 + 4 + 4 * 5 + 1 + NUM_STALL_CAUSES * 5;
+
+    struct Buffer {
+        size_t used = 0;
+        uint8_t bytes[BUFFER_SIZE];
+    };
+
+    void hand_over();
+    void writer_loop();
+
+    FILE* file = nullptr;
+    std::unique_ptr<Buffer[]> pool;
+    Buffer* current = nullptr;
+    SpscRing<Buffer*, NUM_BUFFERS> filled;
+    SpscRing<Buffer*, NUM_BUFFERS> empty;
+    std::atomic<bool> finishing{false};
+    std::atomic<bool> failed{false};
+    std::thread writer;
+
+    uint64_t prev_seq = ~(uint64_t)0;
+    uint32_t prev_pc = 0;
+    uint32_t prev_if = 0;
+};
+
+// Reads a log back, one row at a time
+class EventReader {
+public:
+    EventReader() {}
+    ~EventReader();
+    EventReader(const EventReader&) = delete;
+    EventReader& operator=(const EventReader&) = delete;
+
+    bool open(const std::string& path);
+    // The next row, or false at the end of the log or on a bad record
+    // (then error() is set)
+    bool next(EventRow& row);
+    const std::string& error() const { return error_message; }
+
+private:
+    bool varint(uint64_t& value);
+
+    FILE* file = nullptr;
+    std::string error_message;
+    EventRow prev;
+    bool first = true;
+};
+
+#endif
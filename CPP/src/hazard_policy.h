@@ -0,0 +1,138 @@
+#ifndef HAZARD_POLICY_H
+#define HAZARD_POLICY_H
+
+#include <string>
+
+#include "decode.h"
+#include "scoreboard.h"
+
+// Hazard/forwarding policies for the pipeline engine. A policy is a plain
+// struct of static members passed as a template parameter, so its rules
+// are inlined into the issue loop.
+//
+//   stage_interlock  wait out the previous instruction's stalls before
+//                    every stage, not just IF and ID
+//   on_exe/on_mem    scoreboard updates as the instruction enters EXE/MEM
+//                    (on_exe gets the last EXE cycle of a multi-cycle op)
+//   on_wb            scoreboard update at write back
+//   kind             the policy's name for run-time selection
+//
+// A register counts as busy while its busy-until cycle is >= the cycle in
+// which a reader wants to enter EXE (MEM for a store's rs1).
+
+// Names for picking a policy at run time (the sweep tool). The simulator
+// binaries each have theirs fixed at compile time.
+enum class PolicyKind : uint8_t {
+    FORWARDING,    // ForwardingPolicy
+    NONE,          // NoForwardingPolicy
+    BYPASS,        // BypassPolicy
+    ALU_BYPASS     // AluBypassPolicy
+};
+
+// Marks results busy at EXE (ALU ops) and MEM (loads), and again at WB.
+// Stalls of the previous instruction only hold up IF and ID.
+struct ForwardingPolicy {
+    static const PolicyKind kind = PolicyKind::FORWARDING;
+    static const bool stage_interlock = false;
+
+    static void on_exe(Scoreboard& busy, const InstructionInfo& inst, int cycle) {
+        if (inst.type == OpClass::R || inst.type == OpClass::I ||
+            inst.type == OpClass::LUI || inst.type == OpClass::AUIPC ||
+            inst.type == OpClass::MUL || inst.type == OpClass::DIV) {
+            busy.set_busy(inst.rd, cycle);
+        }
+    }
+
+    static void on_mem(Scoreboard& busy, const InstructionInfo& inst, int cycle) {
+        if (inst.type == OpClass::LOAD) {
+            busy.set_busy(inst.rd, cycle);
+        } else if (inst.type == OpClass::STORE) {
+            busy.set_busy(inst.rs2, cycle);
+        }
+    }
+
+    static void on_wb(Scoreboard& busy, const InstructionInfo& inst, int cycle) {
+        if (has_output_register(inst)) {
+            busy.set_busy(inst.rd, cycle);
+        }
+    }
+};
+
+// No forwarding: results are only visible after write back, and a stalled
+// instruction holds up the one behind it in every stage.
+struct NoForwardingPolicy {
+    static const PolicyKind kind = PolicyKind::NONE;
+    static const bool stage_interlock = true;
+
+    static void on_exe(Scoreboard&, const InstructionInfo&, int) {}
+    static void on_mem(Scoreboard&, const InstructionInfo&, int) {}
+
+    static void on_wb(Scoreboard& busy, const InstructionInfo& inst, int cycle) {
+        if (has_output_register(inst)) {
+            busy.set_busy(inst.rd, cycle);
+        }
+    }
+};
+
+// Full bypass network: ALU results go from the end of EXE straight into
+// the next EXE, loaded values from the end of MEM, so only a load feeding
+// the next instruction costs a bubble. Nothing waits for write back.
+struct BypassPolicy {
+    static const PolicyKind kind = PolicyKind::BYPASS;
+    static const bool stage_interlock = false;
+
+    static void on_exe(Scoreboard& busy, const InstructionInfo& inst, int cycle) {
+        if (has_output_register(inst) && inst.type != OpClass::LOAD) {
+            busy.set_busy(inst.rd, cycle);
+        }
+    }
+
+    static void on_mem(Scoreboard& busy, const InstructionInfo& inst, int cycle) {
+        if (inst.type == OpClass::LOAD) {
+            busy.set_busy(inst.rd, cycle);
+        }
+    }
+
+    static void on_wb(Scoreboard&, const InstructionInfo&, int) {}
+};
+
+// Only the EXE -> EXE path: ALU results are bypassed, loaded values are
+// read from the register file after write back.
+struct AluBypassPolicy {
+    static const PolicyKind kind = PolicyKind::ALU_BYPASS;
+    static const bool stage_interlock = false;
+
+    static void on_exe(Scoreboard& busy, const InstructionInfo& inst, int cycle) {
+        if (has_output_register(inst) && inst.type != OpClass::LOAD) {
+            busy.set_busy(inst.rd, cycle);
+        }
+    }
+
+    static void on_mem(Scoreboard&, const InstructionInfo&, int) {}
+
+    static void on_wb(Scoreboard& busy, const InstructionInfo& inst, int cycle) {
+        if (inst.type == OpClass::LOAD) {
+            busy.set_busy(inst.rd, cycle);
+        }
+    }
+};
+
+inline bool parse_policy_kind(const std::string& name, PolicyKind& kind) {
+    if (name == "forwarding") kind = PolicyKind::FORWARDING;
+    else if (name == "none") kind = PolicyKind::NONE;
+    else if (name == "bypass") kind = PolicyKind::BYPASS;
+    else if (name == "alu-bypass") kind = PolicyKind::ALU_BYPASS;
+    else return false;
+    return true;
+}
+
+inline const char* policy_kind_name(PolicyKind kind) {
+    switch (kind) {
+        case PolicyKind::FORWARDING: return "forwarding";
+        case PolicyKind::NONE: return "none";
+        case PolicyKind::BYPASS: return "bypass";
+        default: return "alu-bypass";
+    }
+}
+
+#endif
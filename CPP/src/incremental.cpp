@@ -0,0 +1,209 @@
+#include "incremental.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "engine.h"
+#include "serialize.h"
+
+using namespace std;
+
+static const char INCREMENTAL_MAGIC[4] = {'R', 'V', 'I', 'N'};
+static const uint32_t INCREMENTAL_VERSION = 2;
+
+void PipelineSnapshot::shift(int delta) {
+    for (int r = 0; r < Scoreboard::NUM_REGS; ++r) {
+        registers.set_busy(r, registers.busy_until(r) + delta);
+    }
+    cycle_of_prev_IF += delta;
+    exe_free += delta;
+}
+
+// Cycles still to come after base; everything before the next fetch is 0
+static int pending(int cycle, int base) {
+    return max(cycle - base, 0);
+}
+
+bool same_pipeline_state(const PipelineSnapshot& a, const PipelineSnapshot& b) {
+    int base_a = a.cycle_of_prev_IF;
+    int base_b = b.cycle_of_prev_IF;
+    if (pending(a.exe_free, base_a) != pending(b.exe_free, base_b)) {
+        return false;
+    }
+    for (int r = 0; r < Scoreboard::NUM_REGS; ++r) {
+        int busy = pending(a.registers.busy_until(r), base_a);
+        if (busy != pending(b.registers.busy_until(r), base_b)) {
+            return false;
+        }
+        // The producer only decides the stall cause while the register is busy
+        if (busy > 0 && a.registers.producer(r) != b.registers.producer(r)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+vector<MatchingBlock> matching_blocks(const uint32_t* old, size_t old_size, const uint32_t* now, size_t now_size,
+                                      size_t max_edits) {
+    size_t prefix = 0;
+    while (prefix < old_size && prefix < now_size && old[prefix] == now[prefix]) {
+        prefix += 1;
+    }
+    size_t suffix = 0;
+    while (suffix < old_size - prefix && suffix < now_size - prefix &&
+           old[old_size - 1 - suffix] == now[now_size - 1 - suffix]) {
+        suffix += 1;
+    }
+    // The middle parts still to be diffed
+    const uint32_t* a = old + prefix;
+    const uint32_t* b = now + prefix;
+    long n = (long)(old_size - prefix - suffix);
+    long m = (long)(now_size - prefix - suffix);
+
+    // Furthest x on each diagonal k = x - y after d edits. v is kept for
+    // every d to walk the path back; history[d] covers diagonals -d..d.
+    vector<MatchingBlock> middle;
+    long limit = min((long)max_edits, n + m);
+    vector<long> v(2 * limit + 3, 0);
+    long offset = limit + 1;
+    vector<vector<long>> history;
+    bool found = n + m == 0;
+    long end_d = 0;
+    for (long d = 0; d <= limit && !found; ++d) {
+        history.push_back(vector<long>(v.begin() + offset - d, v.begin() + offset + d + 1));
+        for (long k = -d; k <= d; k += 2) {
+            long x = k == -d || (k != d && v[offset + k - 1] < v[offset + k + 1]) ? v[offset + k + 1]
+                                                                                  : v[offset + k - 1] + 1;
+            long y = x - k;
+            while (x < n && y < m && a[x] == b[y]) {
+                x += 1;
+                y += 1;
+            }
+            v[offset + k] = x;
+            if (x >= n && y >= m) {
+                found = true;
+                end_d = d;
+                break;
+            }
+        }
+    }
+    if (found && n + m > 0) {
+        long x = n;
+        long y = m;
+        for (long d = end_d; d > 0; --d) {
+            const vector<long>& before = history[d];   // after d - 1 edits
+            auto at = [&before, d](long k) { return before[k + d]; };
+            long k = x - y;
+            long prev_k = k == -d || (k != d && at(k - 1) < at(k + 1)) ? k + 1 : k - 1;
+            long prev_x = at(prev_k);
+            long prev_y = prev_x - prev_k;
+            // The edit leads to (start_x, start_y), then a run of matches
+            long start_x = prev_k == k + 1 ? prev_x : prev_x + 1;
+            long start_y = start_x - k;
+            if (x > start_x) {
+                middle.push_back(MatchingBlock{prefix + start_x, prefix + start_y, (size_t)(x - start_x)});
+            }
+            x = prev_x;
+            y = prev_y;
+        }
+        if (x > 0) {
+            middle.push_back(MatchingBlock{prefix, prefix, (size_t)x});
+        }
+        reverse(middle.begin(), middle.end());
+    }
+
+    vector<MatchingBlock> blocks;
+    if (prefix > 0) {
+        blocks.push_back(MatchingBlock{0, 0, prefix});
+    }
+    blocks.insert(blocks.end(), middle.begin(), middle.end());
+    if (suffix > 0) {
+        blocks.push_back(MatchingBlock{old_size - suffix, now_size - suffix, suffix});
+    }
+    return blocks;
+}
+
+bool IncrementalState::load(const string& path, string& error) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        error = "no previous run in " + path;
+        return false;
+    }
+    char magic[4];
+    uint32_t version;
+    if (!in.read(magic, sizeof(magic)) || memcmp(magic, INCREMENTAL_MAGIC, sizeof(magic)) != 0 ||
+        !get_pod(in, version) || version != INCREMENTAL_VERSION) {
+        error = path + " is not an incremental state file";
+        return false;
+    }
+    if (!get_pod(in, fingerprint) || !get_vector(in, words) || !get_vector(in, rows) ||
+        !get_vector(in, snapshots) || !get_pod(in, counters)) {
+        error = path + " is truncated";
+        return false;
+    }
+    if (rows.size() != words.size() || snapshots.empty() || snapshots[0].row != 0) {
+        error = path + " is inconsistent";
+        return false;
+    }
+    return true;
+}
+
+bool IncrementalState::save(const string& path) const {
+    ofstream out(path, ios::binary);
+    if (!out) {
+        return false;
+    }
+    out.write(INCREMENTAL_MAGIC, sizeof(INCREMENTAL_MAGIC));
+    put_pod(out, INCREMENTAL_VERSION);
+    put_pod(out, fingerprint);
+    put_vector(out, words);
+    put_vector(out, rows);
+    put_vector(out, snapshots);
+    put_pod(out, counters);
+    return (bool)out;
+}
+
+PipelineSnapshot Simulation::take_snapshot(size_t row) const {
+    PipelineSnapshot s;
+    s.row = row;
+    s.registers = register_busy;
+    s.cycle_of_prev_IF = cycle_of_prev_IF;
+    s.exe_free = exe_free;
+    s.counters = perf_counters;
+    return s;
+}
+
+void Simulation::restore_snapshot(const PipelineSnapshot& s) {
+    register_busy = s.registers;
+    cycle_of_prev_IF = s.cycle_of_prev_IF;
+    exe_free = s.exe_free;
+    perf_counters = s.counters;
+}
+
+// Counters of the old run at old_at, with everything up to old_from
+// replaced by the current counters. Rows retire in order, so the last
+// cycle is the later of the two ends.
+PerfCounters Simulation::rebase_counters(const PerfCounters& old_at, const PerfCounters& old_from, int shift) const {
+    PerfCounters c = old_at;
+    c.subtract(old_from);
+    c.add(perf_counters);
+    c.cycles = max<int64_t>((int64_t)perf_counters.cycles, (int64_t)old_at.cycles + shift);
+    return c;
+}
+
+// Everything besides the trace that the listing's timing depends on
+uint64_t Simulation::timing_fingerprint(PolicyKind kind) const {
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](int64_t value) {
+        for (int k = 0; k < 8; ++k) {
+            hash = (hash ^ (uint8_t)(value >> (8 * k))) * 1099511628211ull;
+        }
+    };
+    mix((int)kind);
+    mix(config.load_latency);
+    for (int k = 0; k < NUM_OP_CLASSES; ++k) {
+        mix(config.latency.cycles[k]);
+    }
+    return hash;
+}
@@ -0,0 +1,72 @@
+#ifndef INCREMENTAL_H
+#define INCREMENTAL_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "counters.h"
+#include "scoreboard.h"
+#include "timeline.h"
+
+// Incremental re-simulation (--incremental): a run of a trace listing
+// leaves its timeline and periodic snapshots of the pipeline state in a
+// file. The next run of an edited trace copies the old rows up to the
+// last snapshot before each edit, and after the edit only simulates until
+// its state matches an old snapshot again, shifted by a fixed number of
+// cycles. From there on the old rows are reused with that shift.
+
+// Rows between snapshots
+const size_t INCREMENTAL_INTERVAL = 1024;
+// Insertions plus deletions the diff looks for before treating everything
+// between the common prefix and suffix as one edit
+const size_t INCREMENTAL_MAX_EDITS = 4096;
+
+// State of the scalar in-order pipeline before instruction `row` is
+// issued: everything issue() reads apart from row - 1 of the timeline
+struct PipelineSnapshot {
+    uint64_t row = 0;
+    Scoreboard registers;
+    int cycle_of_prev_IF = 0;
+    int exe_free = 0;
+    PerfCounters counters;
+
+    // Move every cycle in the snapshot by delta
+    void shift(int delta);
+};
+
+// True if a run continuing from a and one from b (with the same rows
+// ahead, and row - 1 of each timeline the same up to the shift) give the
+// same timing, shifted by b.cycle_of_prev_IF - a.cycle_of_prev_IF.
+// Cycles that are already over by the next fetch count as equal.
+bool same_pipeline_state(const PipelineSnapshot& a, const PipelineSnapshot& b);
+
+// A run of equal words: old[old_start + k] == now[now_start + k] for
+// k < length
+struct MatchingBlock {
+    size_t old_start;
+    size_t now_start;
+    size_t length;
+};
+
+// The equal runs of a shortest edit script from old to now, in order
+// (Myers' diff). Past max_edits insertions and deletions only the common
+// prefix and suffix are returned.
+std::vector<MatchingBlock> matching_blocks(const uint32_t* old, size_t old_size, const uint32_t* now,
+                                           size_t now_size, size_t max_edits);
+
+struct IncrementalState {
+    uint64_t fingerprint = 0;      // options the timing depends on
+    std::vector<uint32_t> words;
+    std::vector<TimelineEntry> rows;
+    std::vector<PipelineSnapshot> snapshots;   // by row, starting at row 0
+    PerfCounters counters;         // of the whole run
+
+    // false (with the reason in error) if path does not exist or was not
+    // written by save()
+    bool load(const std::string& path, std::string& error);
+    bool save(const std::string& path) const;
+};
+
+#endif
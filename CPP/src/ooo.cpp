@@ -0,0 +1,132 @@
+#include <algorithm>
+
+#include "engine.h"
+
+using namespace std;
+
+// Out-of-order backend. Instructions are still handled one at a time in
+// program order, but each one's cycles only depend on when its operands
+// are ready, on free units, and on the ROB and issue queue having room, so
+// younger instructions can issue before older ones that are waiting. On
+// the timeline ID is rename/dispatch, EXE is issue, and WB is commit.
+
+// Fetch is in order, issue_width per cycle, and stops while the front end
+// is full (instruction i - width not dispatched yet).
+int Simulation::ooo_fetch_cycle(size_t i) const {
+    int cycle = max(fetch_floor, cycle_of_prev_IF);
+    if (i >= config.issue_width) {
+        cycle = max(cycle, timeline.stage_cycle(i - config.issue_width, STAGE_ID));
+    }
+    return cycle;
+}
+
+void Simulation::issue_ooo(size_t i, const InstructionInfo& inst, const AccessInfo& access) {
+    const OooConfig& ooo = config.ooo;
+    size_t width = config.issue_width;
+
+    current_cycle = ooo_fetch_cycle(i);
+    IF(i);
+    if (icache.enabled() && !icache.access(access.pc)) {
+        current_cycle += config.memory_latency;
+        add_stall(STALL_ICACHE, config.memory_latency);
+        row_profile.icache_miss = true;
+    }
+
+    // Dispatch in order, once the ROB and the issue queue have room. An
+    // issue queue entry is freed the cycle after its instruction issues.
+    int dispatch = current_cycle;
+    if (i > 0) {
+        dispatch = max(dispatch, timeline.stage_cycle(i - 1, STAGE_ID));
+    }
+    if (i >= ooo.rob_size) {
+        dispatch = max(dispatch, timeline.stage_cycle(i - ooo.rob_size, STAGE_WB) + 1);
+    }
+    while (true) {
+        while (!issue_queue.empty() && issue_queue.top() < dispatch) {
+            issue_queue.pop();
+        }
+        if (issue_queue.size() < ooo.iq_size) break;
+        dispatch = issue_queue.top() + 1;
+    }
+    add_stall(STALL_STRUCTURAL, dispatch - current_cycle);
+    current_cycle = dispatch;
+    ID(i);
+
+    // Issue when the last operand is ready and a unit is free
+    int sources[2] = {reads_rs1(inst) ? inst.rs1 : 0, reads_rs2(inst) ? inst.rs2 : 0};
+    int last_reg = -1;
+    int operands = current_cycle;
+    for (int reg : sources) {
+        if (rename.ready[reg] > operands) {
+            operands = rename.ready[reg];
+            last_reg = reg;
+        }
+    }
+    if (last_reg >= 0) {
+        int wait = operands - current_cycle;
+        add_data_stall(last_reg, rename.producer[last_reg] == OpClass::LOAD ? STALL_LOAD_USE : STALL_RAW, wait);
+        current_cycle = operands;
+    }
+    Unit unit = unit_for(inst);
+    int latency = config.latency[inst.type];
+    if (unit != UNIT_MEM) {
+        claim_unit(unit, is_pipelined(inst.type) ? 1 : latency);
+    }
+    add_stall(STALL_STRUCTURAL, current_cycle - operands);
+    issue_queue.push(current_cycle);
+    int issue_cycle = current_cycle;
+    EXE(i);
+
+    current_cycle += latency - 1;
+    add_stall(STALL_EXECUTE, latency - 1);
+
+    // Loads and stores need a memory port. Stores are assumed not to block
+    // later loads (perfect disambiguation).
+    if (unit == UNIT_MEM) {
+        int start = current_cycle;
+        claim_unit(UNIT_MEM, 1);
+        add_stall(STALL_STRUCTURAL, current_cycle - start);
+    }
+    int mem_extra = 0;
+    if (access.has_data_addr && dcache.enabled() && !dcache.access(access.data_addr)) {
+        mem_extra += config.memory_latency;
+        add_stall(STALL_DCACHE, config.memory_latency);
+        row_profile.dcache_miss = true;
+    }
+    if (inst.type == OpClass::LOAD) {
+        mem_extra += config.load_latency;
+        add_stall(STALL_LOAD_LATENCY, config.load_latency);
+    }
+    MEM(i);
+    current_cycle += mem_extra;
+
+    // Results bypass straight to waiting instructions: ALU results at the
+    // end of EXE, loaded values once the access is over
+    if (has_output_register(inst)) {
+        rename.write(inst.rd, inst.type == OpClass::LOAD ? current_cycle : issue_cycle + latency, inst.type);
+    }
+
+    // Commit in order, issue_width per cycle
+    int commit = current_cycle;
+    if (i > 0) {
+        commit = max(commit, timeline.stage_cycle(i - 1, STAGE_WB));
+    }
+    if (i >= width) {
+        commit = max(commit, timeline.stage_cycle(i - width, STAGE_WB) + 1);
+    }
+    add_stall(STALL_COMMIT, commit - current_cycle);
+    current_cycle = commit;
+    timeline.enter(i, STAGE_WB, commit);
+}
+
+// A mispredicted control instruction at row resolves at the end of EXE.
+// Wrong-path instructions are not modelled in this backend, only the
+// fetch cycles they cost.
+void Simulation::ooo_redirect(size_t row) {
+    int resolve_cycle = timeline.stage_cycle(row, STAGE_MEM) - 1;
+    int next_fetch = ooo_fetch_cycle(row + 1);
+    if (resolve_cycle + 1 > next_fetch) {
+        perf_counters.control_cycles += resolve_cycle + 1 - next_fetch;
+    }
+    fetch_floor = max(fetch_floor, resolve_cycle + 1);
+}
@@ -0,0 +1,42 @@
+#ifndef OOO_H
+#define OOO_H
+
+#include <cstring>
+
+#include "decode.h"
+#include "resources.h"
+#include "scoreboard.h"
+
+// Settings of the out-of-order backend (--ooo). Fetch, dispatch and commit
+// handle issue_width instructions per cycle; issue is out of order.
+struct OooConfig {
+    bool enabled = false;
+    unsigned rob_size = 64;
+    unsigned iq_size = 32;
+};
+
+// Register renaming, reduced to what timing needs. With enough physical
+// registers only true dependences are left, so each architectural register
+// just records when its newest value becomes available and what
+// produced it. The ROB size bounds the physical registers in use.
+struct RenameTable {
+    int ready[Scoreboard::NUM_REGS];
+    OpClass producer[Scoreboard::NUM_REGS];
+
+    RenameTable() { clear(); }
+
+    void clear() {
+        memset(ready, 0, sizeof(ready));
+        memset(producer, (int)OpClass::UNKNOWN, sizeof(producer));
+    }
+
+    // x0 is hardwired to zero and never renamed
+    void write(int reg, int cycle, OpClass type) {
+        if (reg != 0) {
+            ready[reg] = cycle;
+            producer[reg] = type;
+        }
+    }
+};
+
+#endif
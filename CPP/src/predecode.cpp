@@ -0,0 +1,274 @@
+#include "decode.h"
+
+#include <cstddef>
+#include <cstring>
+
+using namespace std;
+
+// Bulk decoding of 32-bit words, a vector of them at a time. The kernel is
+// written once with GCC vector types, for as many lanes as the target's
+// vectors hold, and compiled for AVX2 (8 lanes) and SSE4.1 (4 lanes).
+// Every field is a shift and a mask, the class is a compare against each
+// major opcode, and the immediate is built in every format and the right
+// one kept by mask. Compressed words get size 0 in the kernel and are
+// redone by decode_word() afterwards. Without SSE4.1 every word goes
+// through decode_word().
+
+// Where the kernel writes, taken out of the vectors once
+struct ColumnPointers {
+    uint8_t* type;
+    uint8_t* rd;
+    uint8_t* rs1;
+    uint8_t* rs2;
+    uint8_t* funct3;
+    uint8_t* funct7;
+    uint8_t* size;
+    int32_t* imm;
+};
+
+template <size_t LANES>
+struct Lanes {
+    typedef uint32_t U32 __attribute__((vector_size(4 * LANES)));
+    typedef int32_t I32 __attribute__((vector_size(4 * LANES)));
+    typedef uint8_t U8 __attribute__((vector_size(4 * LANES)));
+
+    // Fields of LANES words, one lane each
+    U32 type, rd, rs1, rs2, funct3, funct7, size, imm;
+};
+
+template <size_t LANES>
+static inline __attribute__((always_inline)) Lanes<LANES> decode_lanes(const uint32_t* words) {
+    typedef typename Lanes<LANES>::U32 U32;
+    typedef typename Lanes<LANES>::I32 I32;
+    U32 w;
+    memcpy(&w, words, sizeof(w));
+    I32 sw = (I32)w;
+    Lanes<LANES> d;
+    U32 op = w & 0x7f;
+    d.rd = (w >> 7) & 0x1f;
+    d.rs1 = (w >> 15) & 0x1f;
+    d.rs2 = (w >> 20) & 0x1f;
+    d.funct3 = (w >> 12) & 7;
+    d.funct7 = w >> 25;
+
+    // Masks are all ones in the lanes that match
+    U32 reg = (U32)(op == 0x33);
+    U32 m_ext = reg & (U32)(d.funct7 == 1);
+    U32 is_i = (U32)(op == 0x13);
+    U32 load = (U32)(op == 0x03);
+    U32 store = (U32)(op == 0x23);
+    U32 branch = (U32)(op == 0x63);
+    U32 lui = (U32)(op == 0x37);
+    U32 auipc = (U32)(op == 0x17);
+    U32 jal = (U32)(op == 0x6f);
+    U32 jalr = (U32)(op == 0x67);
+    U32 fence = (U32)(op == 0x0f);
+    U32 system = (U32)(op == 0x73);
+    U32 known = reg | is_i | load | store | branch | lui | auipc | jal | jalr | fence | system;
+
+    d.type = ((reg & ~m_ext) & (uint32_t)OpClass::R) |
+             (m_ext & (U32)(d.funct3 < 4) & (uint32_t)OpClass::MUL) |
+             (m_ext & (U32)(d.funct3 >= 4) & (uint32_t)OpClass::DIV) |
+             (is_i & (uint32_t)OpClass::I) | (load & (uint32_t)OpClass::LOAD) |
+             (store & (uint32_t)OpClass::STORE) | (branch & (uint32_t)OpClass::BRANCH) |
+             (lui & (uint32_t)OpClass::LUI) | (auipc & (uint32_t)OpClass::AUIPC) |
+             (jal & (uint32_t)OpClass::JAL) | (jalr & (uint32_t)OpClass::JALR) |
+             (fence & (uint32_t)OpClass::FENCE) | (system & (uint32_t)OpClass::SYSTEM) |
+             (~known & (uint32_t)OpClass::UNKNOWN);
+
+    U32 sign = (U32)(sw >> 31);
+    U32 imm_i = (U32)(sw >> 20);
+    U32 imm_s = ((U32)(sw >> 25) << 5) | ((w >> 7) & 0x1f);
+    U32 imm_b = (sign << 12) | (((w >> 7) & 1) << 11) | (((w >> 25) & 0x3f) << 5) | (((w >> 8) & 0xf) << 1);
+    U32 imm_u = w & 0xfffff000;
+    U32 imm_j = (sign << 20) | (w & 0xff000) | (((w >> 20) & 1) << 11) | (((w >> 21) & 0x3ff) << 1);
+    d.imm = ((is_i | load | jalr) & imm_i) | (store & imm_s) | (branch & imm_b) | ((lui | auipc) & imm_u) |
+            (jal & imm_j) | (system & (w >> 20));
+
+    U32 compressed = (U32)((w & 3) != 3) & (U32)((w >> 16) == 0);
+    d.size = ~compressed & 4;
+    return d;
+}
+
+// Write bytes 0-3 of each lane to four columns: a 4 x LANES byte
+// transpose, which is one shuffle. Narrowing each field on its own is
+// done lane by lane by the compiler.
+template <size_t LANES>
+static inline __attribute__((always_inline)) void store_columns(uint8_t* a, uint8_t* b, uint8_t* c, uint8_t* d,
+                                                                const typename Lanes<LANES>::U32& packed) {
+    typedef typename Lanes<LANES>::U8 U8;
+    U8 transpose;
+    for (size_t k = 0; k < 4 * LANES; ++k) {
+        transpose[k] = (uint8_t)((k % LANES) * 4 + k / LANES);
+    }
+    U8 bytes = __builtin_shuffle((U8)packed, transpose);
+    uint8_t column[4][LANES];
+    memcpy(column, &bytes, sizeof(column));
+    memcpy(a, column[0], LANES);
+    memcpy(b, column[1], LANES);
+    memcpy(c, column[2], LANES);
+    if (d) {
+        memcpy(d, column[3], LANES);
+    }
+}
+
+// Decode the first count - count % LANES words into columns
+template <size_t LANES>
+static inline __attribute__((always_inline)) void decode_columns(const uint32_t* words, size_t count,
+                                                                 const ColumnPointers& out) {
+    for (size_t i = 0; i + LANES <= count; i += LANES) {
+        Lanes<LANES> d = decode_lanes<LANES>(words + i);
+        store_columns<LANES>(out.type + i, out.rd + i, out.rs1 + i, out.rs2 + i,
+                             d.type | (d.rd << 8) | (d.rs1 << 16) | (d.rs2 << 24));
+        store_columns<LANES>(out.funct3 + i, out.funct7 + i, out.size + i, nullptr,
+                             d.funct3 | (d.funct7 << 8) | (d.size << 16));
+        memcpy(out.imm + i, &d.imm, sizeof(d.imm));
+    }
+}
+
+// The same into InstructionInfo records, which the pipeline reads: the
+// first eight bytes of each are built in the lanes, then the records are
+// written out one by one
+static_assert(sizeof(InstructionInfo) == 12 && offsetof(InstructionInfo, imm) == 8,
+              "decode_records() writes the InstructionInfo layout directly");
+
+template <size_t LANES>
+static inline __attribute__((always_inline)) void decode_records(const uint32_t* words, size_t count,
+                                                                 InstructionInfo* out) {
+    typedef typename Lanes<LANES>::U32 U32;
+    for (size_t i = 0; i + LANES <= count; i += LANES) {
+        Lanes<LANES> d = decode_lanes<LANES>(words + i);
+        U32 low = d.type | (d.rd << 8) | (d.rs1 << 16) | (d.rs2 << 24);
+        U32 high = d.funct3 | (d.funct7 << 8) | (d.size << 16);
+        for (size_t k = 0; k < LANES; ++k) {
+            uint32_t record[3] = {low[k], high[k], d.imm[k]};
+            memcpy(out + i + k, record, sizeof(record));
+        }
+    }
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_PREDECODE_KERNELS 1
+
+__attribute__((target("avx2"))) static size_t columns_avx2(const uint32_t* words, size_t count,
+                                                           const ColumnPointers& out) {
+    decode_columns<8>(words, count, out);
+    return count - count % 8;
+}
+
+__attribute__((target("avx2"))) static size_t records_avx2(const uint32_t* words, size_t count,
+                                                           InstructionInfo* out) {
+    decode_records<8>(words, count, out);
+    return count - count % 8;
+}
+
+__attribute__((target("sse4.1"))) static size_t columns_sse41(const uint32_t* words, size_t count,
+                                                              const ColumnPointers& out) {
+    decode_columns<4>(words, count, out);
+    return count - count % 4;
+}
+
+__attribute__((target("sse4.1"))) static size_t records_sse41(const uint32_t* words, size_t count,
+                                                              InstructionInfo* out) {
+    decode_records<4>(words, count, out);
+    return count - count % 4;
+}
+#endif
+
+// Kernels return how many words they decoded; decode_word() does the rest
+struct KernelChoice {
+    size_t (*columns)(const uint32_t*, size_t, const ColumnPointers&);
+    size_t (*records)(const uint32_t*, size_t, InstructionInfo*);
+    const char* isa;
+};
+
+static size_t columns_none(const uint32_t*, size_t, const ColumnPointers&) {
+    return 0;
+}
+
+static size_t records_none(const uint32_t*, size_t, InstructionInfo*) {
+    return 0;
+}
+
+static KernelChoice choose_kernel() {
+#ifdef HAVE_PREDECODE_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        return KernelChoice{columns_avx2, records_avx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse4.1")) {
+        return KernelChoice{columns_sse41, records_sse41, "sse4.1"};
+    }
+#endif
+    return KernelChoice{columns_none, records_none, "generic"};
+}
+
+static const KernelChoice& kernel_choice() {
+    static const KernelChoice choice = choose_kernel();
+    return choice;
+}
+
+const char* predecode_isa() {
+    return kernel_choice().isa;
+}
+
+static void set_row(const ColumnPointers& out, size_t i, const InstructionInfo& inst) {
+    out.type[i] = (uint8_t)inst.type;
+    out.rd[i] = inst.rd;
+    out.rs1[i] = inst.rs1;
+    out.rs2[i] = inst.rs2;
+    out.funct3[i] = inst.funct3;
+    out.funct7[i] = inst.funct7;
+    out.size[i] = inst.size;
+    out.imm[i] = inst.imm;
+}
+
+InstructionInfo DecodedColumns::row(size_t i) const {
+    InstructionInfo inst;
+    inst.type = (OpClass)type[i];
+    inst.rd = rd[i];
+    inst.rs1 = rs1[i];
+    inst.rs2 = rs2[i];
+    inst.funct3 = funct3[i];
+    inst.funct7 = funct7[i];
+    inst.size = size[i];
+    inst.imm = imm[i];
+    return inst;
+}
+
+void predecode_columns(const uint32_t* words, size_t count, DecodedColumns& columns) {
+    columns.type.resize(count);
+    columns.rd.resize(count);
+    columns.rs1.resize(count);
+    columns.rs2.resize(count);
+    columns.funct3.resize(count);
+    columns.funct7.resize(count);
+    columns.size.resize(count);
+    columns.imm.resize(count);
+    ColumnPointers out = {columns.type.data(), columns.rd.data(), columns.rs1.data(), columns.rs2.data(),
+                          columns.funct3.data(), columns.funct7.data(), columns.size.data(), columns.imm.data()};
+
+    size_t done = kernel_choice().columns(words, count, out);
+    for (size_t i = done; i < count; ++i) {
+        set_row(out, i, decode_word(words[i]));
+    }
+    // Compressed words were left with size 0
+    const uint8_t* sizes = out.size;
+    const uint8_t* p = sizes;
+    while ((p = (const uint8_t*)memchr(p, 0, sizes + done - p)) != nullptr) {
+        size_t i = p - sizes;
+        set_row(out, i, decode_word(words[i]));
+        ++p;
+    }
+}
+
+vector<InstructionInfo> predecode(const uint32_t* words, size_t count) {
+    vector<InstructionInfo> program(count);
+    size_t done = kernel_choice().records(words, count, program.data());
+    for (size_t i = 0; i < count; ++i) {
+        if (i >= done || program[i].size == 0) {
+            program[i] = decode_word(words[i]);
+        }
+    }
+    return program;
+}
@@ -0,0 +1,136 @@
+#include "predictor.h"
+
+#include <istream>
+#include <ostream>
+
+#include "serialize.h"
+
+using namespace std;
+
+// BTB tags store pc | 1 so that an all-zero entry never matches
+static const uint32_t BTB_VALID = 1;
+
+bool parse_predictor_kind(const string& name, PredictorKind& kind) {
+    if (name == "perfect") kind = PredictorKind::PERFECT;
+    else if (name == "not-taken") kind = PredictorKind::NOT_TAKEN;
+    else if (name == "btfn") kind = PredictorKind::BTFN;
+    else if (name == "bimodal") kind = PredictorKind::BIMODAL;
+    else if (name == "gshare") kind = PredictorKind::GSHARE;
+    else return false;
+    return true;
+}
+
+const char* predictor_kind_name(PredictorKind kind) {
+    switch (kind) {
+        case PredictorKind::PERFECT: return "perfect";
+        case PredictorKind::NOT_TAKEN: return "not-taken";
+        case PredictorKind::BTFN: return "btfn";
+        case PredictorKind::BIMODAL: return "bimodal";
+        default: return "gshare";
+    }
+}
+
+BranchPredictor::BranchPredictor(const PredictorConfig& config) : cfg(config) {
+    if (cfg.kind == PredictorKind::BIMODAL || cfg.kind == PredictorKind::GSHARE) {
+        // Start weakly not taken
+        counters.assign(1u << cfg.table_bits, 1);
+    }
+    // Static not-taken never redirects fetch, so it has no use for a BTB
+    if (cfg.kind != PredictorKind::PERFECT && cfg.kind != PredictorKind::NOT_TAKEN) {
+        btb.assign(cfg.btb_entries, BtbEntry{0, 0});
+    }
+}
+
+void BranchPredictor::save(ostream& out) const {
+    put_pod(out, cfg);
+    put_vector(out, counters);
+    put_vector(out, btb);
+    put_pod(out, history);
+    put_pod(out, lookups);
+    put_pod(out, mispredicts);
+    put_pod(out, btb_hits);
+    put_pod(out, btb_lookups);
+}
+
+bool BranchPredictor::load(istream& in) {
+    PredictorConfig saved;
+    if (!get_pod(in, saved)) {
+        return false;
+    }
+    if (saved.kind != cfg.kind || saved.table_bits != cfg.table_bits ||
+        saved.history_bits != cfg.history_bits || saved.btb_entries != cfg.btb_entries) {
+        return false;
+    }
+    return get_sized_vector(in, counters) && get_sized_vector(in, btb) && get_pod(in, history) &&
+           get_pod(in, lookups) && get_pod(in, mispredicts) && get_pod(in, btb_hits) &&
+           get_pod(in, btb_lookups);
+}
+
+// Tables are indexed by pc >> 1, so compressed instructions two bytes
+// apart do not share an entry
+unsigned BranchPredictor::counter_index(uint32_t pc) const {
+    unsigned index = pc >> 1;
+    if (cfg.kind == PredictorKind::GSHARE) {
+        index ^= history;
+    }
+    return index & ((1u << cfg.table_bits) - 1);
+}
+
+const BranchPredictor::BtbEntry* BranchPredictor::btb_lookup(uint32_t pc) const {
+    if (btb.empty()) {
+        return nullptr;
+    }
+    const BtbEntry& e = btb[(pc >> 1) & (btb.size() - 1)];
+    return e.tag == (pc | BTB_VALID) ? &e : nullptr;
+}
+
+bool BranchPredictor::predict_taken(uint32_t pc, const InstructionInfo& inst) const {
+    if (inst.type != OpClass::BRANCH) {
+        return true;
+    }
+    switch (cfg.kind) {
+        case PredictorKind::BTFN:
+            return inst.imm < 0;
+        case PredictorKind::BIMODAL:
+        case PredictorKind::GSHARE:
+            return counters[counter_index(pc)] >= 2;
+        default:
+            return false;
+    }
+}
+
+uint32_t BranchPredictor::predict(uint32_t pc, const InstructionInfo& inst) const {
+    uint32_t fall_through = pc + inst.size;
+    if (cfg.kind == PredictorKind::NOT_TAKEN || !predict_taken(pc, inst)) {
+        return fall_through;
+    }
+    const BtbEntry* e = btb_lookup(pc);
+    return e ? e->target : fall_through;
+}
+
+void BranchPredictor::update(uint32_t pc, const InstructionInfo& inst, uint32_t predicted, uint32_t actual) {
+    bool taken = actual != pc + inst.size;
+
+    lookups += 1;
+    if (predicted != actual) {
+        mispredicts += 1;
+    }
+    if (!btb.empty() && taken) {
+        btb_lookups += 1;
+        if (btb_lookup(pc)) {
+            btb_hits += 1;
+        }
+        BtbEntry& e = btb[(pc >> 1) & (btb.size() - 1)];
+        e.tag = pc | BTB_VALID;
+        e.target = actual;
+    }
+
+    if (inst.type == OpClass::BRANCH && !counters.empty()) {
+        uint8_t& c = counters[counter_index(pc)];
+        if (taken && c < 3) c += 1;
+        if (!taken && c > 0) c -= 1;
+        if (cfg.kind == PredictorKind::GSHARE) {
+            history = ((history << 1) | (taken ? 1 : 0)) & ((1u << cfg.history_bits) - 1);
+        }
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef PREDICTOR_H
+#define PREDICTOR_H
+
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "decode.h"
+
+enum class PredictorKind : uint8_t {
+    PERFECT,     // oracle, never mispredicts
+    NOT_TAKEN,   // static: always fall through
+    BTFN,        // static: backward taken, forward not taken
+    BIMODAL,     // 2-bit saturating counters indexed by pc
+    GSHARE       // 2-bit counters indexed by pc xor global history
+};
+
+// Largest tables the command line accepts
+const unsigned MAX_PREDICTOR_BITS = 24;
+const unsigned MAX_BTB_ENTRIES = 1u << 20;
+
+struct PredictorConfig {
+    PredictorKind kind = PredictorKind::NOT_TAKEN;
+    unsigned table_bits = 10;    // log2 of counter table size
+    unsigned history_bits = 10;  // global history length for gshare
+    unsigned btb_entries = 256;  // direct-mapped, power of two; 0 disables
+};
+
+bool parse_predictor_kind(const std::string& name, PredictorKind& kind);
+const char* predictor_kind_name(PredictorKind kind);
+
+inline bool is_control(const InstructionInfo& inst) {
+    return inst.type == OpClass::BRANCH || inst.type == OpClass::JAL || inst.type == OpClass::JALR;
+}
+
+// Fetch-stage control flow prediction. The direction comes from the
+// configured scheme; a taken prediction also needs a BTB hit to supply the
+// target, otherwise fetch falls through. Resolution happens in EXE.
+class BranchPredictor {
+public:
+    explicit BranchPredictor(const PredictorConfig& config = PredictorConfig());
+
+    // Next pc fetch will use after the control instruction at pc, which
+    // falls through to pc + inst.size.
+    uint32_t predict(uint32_t pc, const InstructionInfo& inst) const;
+
+    // Train on the resolved outcome and count it against the prediction.
+    void update(uint32_t pc, const InstructionInfo& inst, uint32_t predicted, uint32_t actual);
+
+    const PredictorConfig& config() const { return cfg; }
+
+    uint64_t lookups = 0;
+    uint64_t mispredicts = 0;
+    uint64_t btb_hits = 0;
+    uint64_t btb_lookups = 0;
+
+    // Checkpoint support. load() fails if the checkpoint was taken with a
+    // different predictor configuration.
+    void save(std::ostream& out) const;
+    bool load(std::istream& in);
+
+private:
+    struct BtbEntry {
+        uint32_t tag;
+        uint32_t target;
+    };
+
+    bool predict_taken(uint32_t pc, const InstructionInfo& inst) const;
+    unsigned counter_index(uint32_t pc) const;
+    const BtbEntry* btb_lookup(uint32_t pc) const;
+
+    PredictorConfig cfg;
+    std::vector<uint8_t> counters;
+    std::vector<BtbEntry> btb;
+    uint32_t history = 0;
+};
+
+#endif
@@ -0,0 +1,186 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+#include "engine.h"
+
+using namespace std;
+
+uint64_t HotspotEntry::stall_cycles() const {
+    uint64_t total = 0;
+    for (int s = 0; s < NUM_STALL_CAUSES; ++s) {
+        total += stalls[s];
+    }
+    return total;
+}
+
+void Profile::reset(size_t instructions) {
+    entries.assign(instructions, HotspotEntry());
+    pool.clear();
+}
+
+void Profile::add(size_t index, const RowProfile& row) {
+    HotspotEntry& e = entries[index];
+    e.executions += 1;
+    for (int s = 0; s < NUM_STALL_CAUSES; ++s) {
+        e.stalls[s] += row.stalls[s];
+    }
+    e.icache_misses += row.icache_miss;
+    e.dcache_misses += row.dcache_miss;
+    for (int k = 0; k < row.data_count; ++k) {
+        const DataStall& d = row.data[k];
+        uint32_t* link = &e.first_data;
+        while (*link != HotspotEntry::NONE) {
+            DataStall& other = pool[*link].stall;
+            if (other.producer_pc == d.producer_pc && other.reg == d.reg && other.cause == d.cause) {
+                other.cycles += d.cycles;
+                break;
+            }
+            link = &pool[*link].next;
+        }
+        if (*link == HotspotEntry::NONE) {
+            *link = (uint32_t)pool.size();
+            pool.push_back(PooledStall{d, HotspotEntry::NONE});
+        }
+    }
+}
+
+vector<DataStall> Profile::data_stalls(const HotspotEntry& e) const {
+    vector<DataStall> data;
+    for (uint32_t k = e.first_data; k != HotspotEntry::NONE; k = pool[k].next) {
+        data.push_back(pool[k].stall);
+    }
+    return data;
+}
+
+static string hex_label(uint32_t value, int digits) {
+    char text[16];
+    snprintf(text, sizeof(text), "%0*x", digits, value);
+    return text;
+}
+
+static string register_name(int reg) {
+    return (reg < NUM_INT_REGS ? "x" : "f") + to_string(reg % NUM_INT_REGS);
+}
+
+// "0x00010008 00532023", plus the input line for a trace
+static string instruction_label(const Program& program, size_t index) {
+    string label = "0x" + hex_label(program.pc_of(index), 8) + " " +
+                   hex_label(program.words()[index], program.insts[index].size == 2 ? 4 : 8);
+    if (!program.elf.is_open()) {
+        label += " (line " + to_string(index + 1) + ")";
+    }
+    return label;
+}
+
+// "Load-use 200, Structural 3; x5 <- 0x0001000c 200"
+static string describe_causes(const Profile& profile, const HotspotEntry& e) {
+    vector<int> causes;
+    for (int s = 0; s < NUM_STALL_CAUSES; ++s) {
+        if (e.stalls[s] > 0) {
+            causes.push_back(s);
+        }
+    }
+    stable_sort(causes.begin(), causes.end(), [&e](int a, int b) { return e.stalls[a] > e.stalls[b]; });
+    string text;
+    for (int s : causes) {
+        text += (text.empty() ? "" : ", ") + string(stall_cause_name((StallCause)s)) + " " + to_string(e.stalls[s]);
+    }
+
+    vector<DataStall> data = profile.data_stalls(e);
+    stable_sort(data.begin(), data.end(), [](const DataStall& a, const DataStall& b) { return a.cycles > b.cycles; });
+    for (size_t k = 0; k < data.size(); ++k) {
+        text += (k == 0 ? "; " : ", ") + register_name(data[k].reg) + " <- 0x" + hex_label(data[k].producer_pc, 8) +
+                " " + to_string(data[k].cycles);
+    }
+    return text;
+}
+
+void print_hotspots(ostream& out, const Profile& profile, const Program& program, size_t top) {
+    SavedFormat saved(out);
+    const vector<HotspotEntry>& entries = profile.all();
+    // (cost, index) of every instruction that lost cycles; only the top
+    // ones need sorting
+    vector<pair<uint64_t, size_t>> order;
+    uint64_t total = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        uint64_t cost = entries[i].cost();
+        if (cost > 0) {
+            order.push_back(make_pair(cost, i));
+            total += cost;
+        }
+    }
+    size_t shown = min(top, order.size());
+    partial_sort(order.begin(), order.begin() + shown, order.end(),
+                 [](const pair<uint64_t, size_t>& a, const pair<uint64_t, size_t>& b) {
+                     return a.first != b.first ? a.first > b.first : a.second < b.second;
+                 });
+    out << "Hotspots: " << order.size() << " of " << entries.size() << " instructions lost " << total
+        << " cycles to stalls and mispredictions" << "\n";
+    if (order.empty()) {
+        out.flush();
+        return;
+    }
+
+    out << left << setw(12) << "PC" << setw(10) << "Word" << setw(7) << "Line" << right << setw(10) << "Count"
+        << setw(10) << "Stalls" << setw(9) << "Control" << setw(8) << "I-miss" << setw(8) << "D-miss"
+        << setw(9) << "Mispred" << setw(8) << "Share" << "  Causes" << "\n";
+    for (size_t k = 0; k < shown; ++k) {
+        size_t i = order[k].second;
+        const HotspotEntry& e = entries[i];
+        string line = program.elf.is_open() ? "-" : to_string(i + 1);
+        out << left << setw(12) << "0x" + hex_label(program.pc_of(i), 8)
+            << setw(10) << hex_label(program.words()[i], program.insts[i].size == 2 ? 4 : 8) << setw(7) << line
+            << right << setw(10) << e.executions << setw(10) << e.stall_cycles() << setw(9) << e.control_cycles
+            << setw(8) << e.icache_misses << setw(8) << e.dcache_misses << setw(9) << e.mispredicts
+            << setw(7) << fixed << setprecision(1) << 100.0 * e.cost() / total << "%"
+            << "  " << describe_causes(profile, e) << "\n";
+    }
+    if (order.size() > shown) {
+        out << "(" << order.size() - shown << " more; see --profile-top)" << "\n";
+    }
+    out.flush();
+}
+
+bool write_folded_stacks(const string& path, const Profile& profile, const Program& program) {
+    ofstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            return false;
+        }
+    }
+    ostream& out = path == "-" ? cout : file;
+
+    const vector<HotspotEntry>& entries = profile.all();
+    for (size_t i = 0; i < entries.size(); ++i) {
+        const HotspotEntry& e = entries[i];
+        if (e.executions == 0) {
+            continue;
+        }
+        string frame = instruction_label(program, i);
+        out << frame << ";Execute " << e.executions << "\n";
+
+        // Data stalls split by register and producer, the rest by cause
+        uint64_t attributed[NUM_STALL_CAUSES] = {};
+        for (const DataStall& d : profile.data_stalls(e)) {
+            out << frame << ";" << stall_cause_name((StallCause)d.cause) << ";" << register_name(d.reg)
+                << " <- 0x" << hex_label(d.producer_pc, 8) << " " << d.cycles << "\n";
+            attributed[d.cause] += d.cycles;
+        }
+        for (int s = 0; s < NUM_STALL_CAUSES; ++s) {
+            if (e.stalls[s] > attributed[s]) {
+                out << frame << ";" << stall_cause_name((StallCause)s) << " " << e.stalls[s] - attributed[s] << "\n";
+            }
+        }
+        if (e.control_cycles > 0) {
+            out << frame << ";Mispredict " << e.control_cycles << "\n";
+        }
+    }
+    out.flush();
+    return true;
+}
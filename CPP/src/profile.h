@@ -0,0 +1,88 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+#include "counters.h"
+
+struct Program;
+
+// Cycles an instruction waited for a register, and the instruction (by
+// pc) whose result it was waiting for
+struct DataStall {
+    uint32_t producer_pc = 0;
+    uint8_t reg = 0;
+    uint8_t cause = STALL_RAW;   // STALL_RAW or STALL_LOAD_USE
+    uint32_t cycles = 0;
+};
+
+// What the instruction being issued ran into. The engine fills this in
+// as the instruction goes through the pipeline, whether or not profiling
+// is on; it is only added to the profile once the instruction retires.
+struct RowProfile {
+    uint32_t pc = 0;
+    uint32_t stalls[NUM_STALL_CAUSES] = {};
+    DataStall data[2];   // a store waits for rs2 and rs1 separately
+    int data_count = 0;
+    bool icache_miss = false;
+    bool dcache_miss = false;
+};
+
+// Totals for one static instruction. Profiling a trace listing needs one
+// of these per line, so they are kept to 64 bytes: per-instruction cycle
+// counts fit in 32 bits, and the data stalls live in a shared pool.
+struct HotspotEntry {
+    static constexpr uint32_t NONE = ~0u;
+
+    uint64_t executions = 0;
+    uint32_t stalls[NUM_STALL_CAUSES] = {};
+    uint32_t icache_misses = 0;
+    uint32_t dcache_misses = 0;
+    uint32_t mispredicts = 0;
+    uint32_t control_cycles = 0;   // fetch cycles lost to its mispredictions
+    uint32_t first_data = NONE;    // head of its list in the data stall pool
+
+    uint64_t stall_cycles() const;
+    uint64_t cost() const { return stall_cycles() + control_cycles; }
+};
+
+// Per-PC hotspot profile: one entry per instruction of the program, so
+// adding a retired instruction is a few additions into a flat array.
+class Profile {
+public:
+    // Size the profile for a program; 0 instructions turns it off
+    void reset(size_t instructions);
+    bool enabled() const { return !entries.empty(); }
+
+    // Add a retired instruction of the program's index-th instruction
+    void add(size_t index, const RowProfile& row);
+    HotspotEntry& operator[](size_t index) { return entries[index]; }
+    const std::vector<HotspotEntry>& all() const { return entries; }
+
+    // RAW and load-use cycles of an entry by register and producer
+    std::vector<DataStall> data_stalls(const HotspotEntry& e) const;
+
+private:
+    struct PooledStall {
+        DataStall stall;
+        uint32_t next;
+    };
+
+    std::vector<HotspotEntry> entries;
+    std::vector<PooledStall> pool;
+};
+
+// Print the top instructions by stall and misprediction cycles
+void print_hotspots(std::ostream& out, const Profile& profile, const Program& program, size_t top);
+
+// Write the profile as folded stacks ("frame;frame;frame count" lines), the
+// input format of flamegraph.pl and speedscope. Every instruction gets one
+// cycle per execution, plus its stall cycles by cause and producer. A path
+// of "-" writes to stdout. Returns false if the file cannot be written.
+bool write_folded_stacks(const std::string& path, const Profile& profile, const Program& program);
+
+#endif
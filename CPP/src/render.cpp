@@ -0,0 +1,277 @@
+#include "render.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+
+using namespace std;
+
+static const char* const stage_names[NUM_STAGES] = {"IF", "ID", "EXE", "MEM", "WB"};
+static const char* const squashed_names[NUM_STAGES] = {"if", "id", "exe", "mem", "wb"};
+
+// Grid columns are three characters wide, separated by " | "
+static const size_t CELL_WIDTH = 3;
+static const size_t LABEL_WIDTH = 10;
+
+bool parse_table_format(const string& name, TableFormat& format) {
+    if (name == "grid") format = TableFormat::GRID;
+    else if (name == "csv") format = TableFormat::CSV;
+    else if (name == "semicolon") format = TableFormat::SEMICOLON;
+    else if (name == "rle") format = TableFormat::RLE;
+    else return false;
+    return true;
+}
+
+static bool parse_bound(const string& text, uint64_t max, uint64_t& value) {
+    if (text.empty()) {
+        return true;
+    }
+    if (!isdigit((unsigned char)text[0])) {
+        return false;
+    }
+    errno = 0;
+    char* end;
+    unsigned long long n = strtoull(text.c_str(), &end, 10);
+    if (*end != '\0' || errno == ERANGE || n == 0 || n > max) {
+        return false;
+    }
+    value = n;
+    return true;
+}
+
+bool parse_range(const string& text, uint64_t max, uint64_t& first, uint64_t& last) {
+    size_t colon = text.find(':');
+    if (colon == string::npos) {
+        return false;
+    }
+    uint64_t a = first, b = last;
+    if (!parse_bound(text.substr(0, colon), max, a) || !parse_bound(text.substr(colon + 1), max, b)) {
+        return false;
+    }
+    if (b != 0 && b < a) {
+        return false;
+    }
+    first = a;
+    last = b;
+    return true;
+}
+
+OutputBuffer::OutputBuffer(FILE* out, size_t capacity) : out(out), data(capacity) {
+    // Anything already written through stdio or iostreams goes first
+    fflush(out);
+}
+
+void OutputBuffer::put_spaces(size_t n) {
+    static const char spaces[] = "                ";
+    while (n > 0) {
+        size_t chunk = n < sizeof(spaces) - 1 ? n : sizeof(spaces) - 1;
+        put(spaces, chunk);
+        n -= chunk;
+    }
+}
+
+void OutputBuffer::put_number(uint64_t n) {
+    char text[20];
+    size_t length = 0;
+    do {
+        text[sizeof(text) - 1 - length++] = '0' + n % 10;
+        n /= 10;
+    } while (n > 0);
+    put(text + sizeof(text) - length, length);
+}
+
+void OutputBuffer::put_hex_word(uint32_t word) {
+    static const char digits[] = "0123456789abcdef";
+    char text[8];
+    for (int k = 7; k >= 0; --k) {
+        text[k] = digits[word & 0xf];
+        word >>= 4;
+    }
+    put(text, 8);
+}
+
+void OutputBuffer::flush() {
+    if (used > 0) {
+        fwrite(data.data(), 1, used, out);
+        used = 0;
+    }
+    fflush(out);
+}
+
+// Stage cycles of one row, worked out once instead of per cell
+struct RowStages {
+    int cycle[NUM_STAGES];
+    int last;    // last stage entered (earlier than WB if squashed)
+    const char* const* names;
+
+    RowStages(const Timeline& timeline, size_t i) {
+        last = timeline.last_stage(i);
+        names = last == STAGE_WB ? stage_names : squashed_names;
+        for (int s = 0; s <= last; ++s) {
+            cycle[s] = timeline.stage_cycle(i, (Stage)s);
+        }
+    }
+};
+
+// Call emit(text, n) for runs of identical cells covering cycles a..b.
+// Blank cells are passed as " ".
+template <class Emit>
+static void walk_cells(const RowStages& row, int a, int b, Emit emit) {
+    int c = a;
+    auto run = [&](const char* text, int until) {
+        if (until > b) {
+            until = b;
+        }
+        if (until >= c) {
+            emit(text, until - c + 1);
+            c = until + 1;
+        }
+    };
+    run(" ", row.cycle[0] - 1);
+    for (int s = 0; s <= row.last; ++s) {
+        run(row.names[s], row.cycle[s]);
+        if (s < row.last) {
+            run("-", row.cycle[s + 1] - 1);
+        }
+    }
+    run(" ", b);
+}
+
+static void put_grid_cell(OutputBuffer& buf, const char* text) {
+    size_t length = strlen(text);
+    buf.put(text, length);
+    buf.put_spaces(CELL_WIDTH - length);
+}
+
+static void render_grid_header(OutputBuffer& buf, int a, int b) {
+    buf.put("Instruction |  ", 15);
+    for (int c = a; c <= b; ++c) {
+        size_t before = 0;
+        for (int n = c; n > 0; n /= 10) {
+            before += 1;
+        }
+        buf.put_number(c);
+        if (before < CELL_WIDTH) {
+            buf.put_spaces(CELL_WIDTH - before);
+        }
+        if (c != b) {
+            buf.put(" | ", 3);
+        }
+    }
+    buf.put('\n');
+
+    buf.put("-----------|-", 13);
+    for (int c = a; c <= b; ++c) {
+        buf.put("---", 3);
+        if (c != b) {
+            buf.put("-|-", 3);
+        }
+    }
+    buf.put('\n');
+}
+
+static void render_grid_row(OutputBuffer& buf, const RowStages& row, uint32_t word, int a, int b) {
+    buf.put_hex_word(word);
+    buf.put_spaces(LABEL_WIDTH - 8);
+    buf.put(" | ", 3);
+    bool first = true;
+    walk_cells(row, a, b, [&](const char* text, int n) {
+        for (int k = 0; k < n; ++k) {
+            if (!first) {
+                buf.put(" | ", 3);
+            }
+            put_grid_cell(buf, text);
+            first = false;
+        }
+    });
+    buf.put('\n');
+}
+
+static void render_csv_header(OutputBuffer& buf, int a, int b) {
+    buf.put("Instruction", 11);
+    for (int c = a; c <= b; ++c) {
+        buf.put(',');
+        buf.put_number(c);
+    }
+    buf.put('\n');
+}
+
+static void render_csv_row(OutputBuffer& buf, const RowStages& row, uint32_t word, int a, int b) {
+    buf.put_hex_word(word);
+    walk_cells(row, a, b, [&](const char* text, int n) {
+        bool blank = text[0] == ' ';
+        for (int k = 0; k < n; ++k) {
+            buf.put(',');
+            if (!blank) {
+                buf.put(text, strlen(text));
+            }
+        }
+    });
+    buf.put('\n');
+}
+
+// Like the readme example: cells up to the row's last stage, no padding
+static void render_semicolon_row(OutputBuffer& buf, const RowStages& row, uint32_t word, int a, int b) {
+    buf.put_hex_word(word);
+    int end = row.cycle[row.last];
+    walk_cells(row, a, end < b ? end : b, [&](const char* text, int n) {
+        bool blank = text[0] == ' ';
+        for (int k = 0; k < n; ++k) {
+            buf.put("; ", 2);
+            if (!blank) {
+                buf.put(text, strlen(text));
+            }
+        }
+    });
+    buf.put(";\n", 2);
+}
+
+// One entry per stage, with stall runs written as a count: the row's
+// length does not depend on how many cycles it spans
+static void render_rle_row(OutputBuffer& buf, const RowStages& row, uint32_t word) {
+    buf.put_hex_word(word);
+    buf.put(" @", 2);
+    buf.put_number(row.cycle[0]);
+    for (int s = 0; s <= row.last; ++s) {
+        if (s > 0) {
+            int stalls = row.cycle[s] - row.cycle[s - 1] - 1;
+            if (stalls > 0) {
+                buf.put(' ');
+                buf.put_number(stalls);
+                buf.put('-');
+            }
+        }
+        buf.put(' ');
+        buf.put(row.names[s], strlen(row.names[s]));
+    }
+    buf.put('\n');
+}
+
+void render_table(const Timeline& timeline, const uint32_t* words, size_t count, int last_cycle,
+                  const RenderOptions& options, FILE* out) {
+    int a = options.first_cycle;
+    int b = options.last_cycle > 0 && options.last_cycle < last_cycle ? options.last_cycle : last_cycle;
+    size_t first = options.first_row - 1;
+    size_t end = options.last_row > 0 && options.last_row < count ? options.last_row : count;
+
+    OutputBuffer buf(out);
+    if (options.format == TableFormat::GRID) {
+        render_grid_header(buf, a, b);
+    } else if (options.format == TableFormat::CSV) {
+        render_csv_header(buf, a, b);
+    }
+
+    for (size_t i = first; i < end; ++i) {
+        RowStages row(timeline, i);
+        // With a cycle window, rows entirely outside it are left out
+        if (options.has_cycle_window() && (row.cycle[row.last] < a || row.cycle[0] > b)) {
+            continue;
+        }
+        switch (options.format) {
+            case TableFormat::GRID: render_grid_row(buf, row, words[i], a, b); break;
+            case TableFormat::CSV: render_csv_row(buf, row, words[i], a, b); break;
+            case TableFormat::SEMICOLON: render_semicolon_row(buf, row, words[i], a, b); break;
+            case TableFormat::RLE: render_rle_row(buf, row, words[i]); break;
+        }
+    }
+}
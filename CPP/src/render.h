@@ -0,0 +1,79 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "timeline.h"
+
+enum class TableFormat : uint8_t {
+    GRID,        // the original "Instruction | 1 | 2 ..." table
+    CSV,         // one column per cycle
+    SEMICOLON,   // "label; ; IF; ID; -; EXE; MEM; WB;" as in the readme
+    RLE          // "label @cycle IF ID 2- EXE MEM WB", one entry per stage
+};
+
+bool parse_table_format(const std::string& name, TableFormat& format);
+
+// What part of the timeline to print. Cycles and rows are 1-based and
+// inclusive; a last value of 0 means "to the end".
+struct RenderOptions {
+    TableFormat format = TableFormat::GRID;
+    int first_cycle = 1;
+    int last_cycle = 0;
+    size_t first_row = 1;
+    size_t last_row = 0;
+
+    bool has_cycle_window() const { return first_cycle > 1 || last_cycle > 0; }
+};
+
+// Parse "a:b", where either bound may be left out ("100:", ":50"). Bounds
+// above max are refused.
+bool parse_range(const std::string& text, uint64_t max, uint64_t& first, uint64_t& last);
+
+// Collects output in a large buffer and writes it out in big chunks, so
+// rendering makes a handful of write calls instead of one per cell.
+class OutputBuffer {
+public:
+    explicit OutputBuffer(FILE* out, size_t capacity = 1 << 20);
+    ~OutputBuffer() { flush(); }
+
+    void put(const char* text, size_t length) {
+        if (used + length > data.size()) {
+            flush();
+            if (length > data.size()) {
+                fwrite(text, 1, length, out);
+                return;
+            }
+        }
+        memcpy(&data[used], text, length);
+        used += length;
+    }
+    void put(char c) {
+        if (used == data.size()) {
+            flush();
+        }
+        data[used++] = c;
+    }
+    void put_spaces(size_t n);
+    void put_number(uint64_t n);
+    void put_hex_word(uint32_t word);
+
+    void flush();
+
+private:
+    FILE* out;
+    std::vector<char> data;
+    size_t used = 0;
+};
+
+// Print the rows of timeline for the given instruction words. last_cycle
+// is the final cycle of the run (the width of the full grid).
+void render_table(const Timeline& timeline, const uint32_t* words, size_t count, int last_cycle,
+                  const RenderOptions& options, FILE* out);
+
+#endif
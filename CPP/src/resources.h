@@ -0,0 +1,138 @@
+#ifndef RESOURCES_H
+#define RESOURCES_H
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "counters.h"
+#include "decode.h"
+
+// Execution units of the wide pipeline. ALU and branch units are used in
+// EXE, memory ports in MEM.
+enum Unit {
+    UNIT_ALU,
+    UNIT_MEM,
+    UNIT_BRANCH,
+    NUM_UNITS
+};
+
+inline Unit unit_for(const InstructionInfo& inst) {
+    switch (inst.type) {
+        case OpClass::LOAD:
+        case OpClass::STORE:
+            return UNIT_MEM;
+        case OpClass::BRANCH:
+        case OpClass::JAL:
+        case OpClass::JALR:
+            return UNIT_BRANCH;
+        default:
+            return UNIT_ALU;
+    }
+}
+
+// Cycles each class of instruction spends in EXE. Everything takes one
+// cycle except the M extension; the divider is not pipelined.
+struct LatencyTable {
+    int cycles[NUM_OP_CLASSES];
+
+    LatencyTable() {
+        for (int k = 0; k < NUM_OP_CLASSES; ++k) {
+            cycles[k] = 1;
+        }
+        cycles[(int)OpClass::MUL] = 3;
+        cycles[(int)OpClass::DIV] = 32;
+    }
+
+    int operator[](OpClass type) const { return cycles[(int)type]; }
+
+    int longest() const {
+        int longest = 0;
+        for (int k = 0; k < NUM_OP_CLASSES; ++k) {
+            longest = cycles[k] > longest ? cycles[k] : longest;
+        }
+        return longest;
+    }
+};
+
+// Whether a new instruction can start in the unit every cycle
+inline bool is_pipelined(OpClass type) {
+    return type != OpClass::DIV;
+}
+
+// Number of instructions using each unit in each recent cycle. Only a
+// window of cycles is kept (slot = cycle & (window - 1)), which must span
+// every cycle still booked or asked about; see Simulation::unit_window().
+class UnitTable {
+public:
+    static const int DEFAULT_WINDOW = 4096;
+
+    UnitTable() { resize(DEFAULT_WINDOW); }
+
+    // window must be a power of two
+    void resize(int window) {
+        entries.assign(window, Entry());
+        mask = window - 1;
+        clear();
+    }
+
+    void clear() {
+        for (auto& e : entries) {
+            e.cycle = -1;
+        }
+        log.clear();
+        logging = false;
+    }
+
+    int used(int cycle, Unit unit) const {
+        const Entry& e = entries[cycle & mask];
+        return e.cycle == cycle ? e.used[unit] : 0;
+    }
+
+    void take(int cycle, Unit unit) {
+        Entry& e = entries[cycle & mask];
+        if (e.cycle != cycle) {
+            e.cycle = cycle;
+            memset(e.used, 0, sizeof(e.used));
+        }
+        e.used[unit] += 1;
+        if (logging) {
+            log.push_back(Taken{cycle, unit});
+        }
+    }
+
+    // While logging, every unit taken is remembered so that release_after()
+    // can hand back the cycles a flushed wrong path never got to use.
+    void start_logging() {
+        log.clear();
+        logging = true;
+    }
+
+    void release_after(int cycle) {
+        for (const auto& t : log) {
+            Entry& e = entries[t.cycle & mask];
+            if (t.cycle > cycle && e.cycle == t.cycle) {
+                e.used[t.unit] -= 1;
+            }
+        }
+        log.clear();
+        logging = false;
+    }
+
+private:
+    struct Entry {
+        int32_t cycle;
+        uint16_t used[NUM_UNITS];
+    };
+    struct Taken {
+        int32_t cycle;
+        Unit unit;
+    };
+
+    std::vector<Entry> entries;
+    int mask;
+    std::vector<Taken> log;
+    bool logging = false;
+};
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SCOREBOARD_H
+#define SCOREBOARD_H
+
+#include <cstdint>
+#include <cstring>
+
+#include "decode.h"
+
+// Register scoreboard: for each architectural register, the last cycle in
+// which its value is still being produced. Integer registers are x0-x31,
+// floating point registers f0-f31 live at index 32 + n.
+class Scoreboard {
+public:
+    static const int NUM_REGS = 64;
+    static const int FP_BASE = 32;
+
+    Scoreboard() { clear(); }
+
+    void clear() {
+        memset(busy, 0, sizeof(busy));
+        memset(producers, (int)OpClass::UNKNOWN, sizeof(producers));
+    }
+
+    int busy_until(int reg) const { return busy[reg]; }
+
+    bool is_busy(int reg, int cycle) const { return busy[reg] >= cycle; }
+
+    // x0 is hardwired to zero, so writes to it never make it busy
+    void set_busy(int reg, int cycle) {
+        if (reg != 0) {
+            busy[reg] = cycle;
+        }
+    }
+
+    // Class of the instruction that last wrote reg, used to tell load-use
+    // stalls apart from other RAW stalls
+    OpClass producer(int reg) const { return producers[reg]; }
+    void set_producer(int reg, OpClass type) { producers[reg] = type; }
+
+private:
+    alignas(64) int32_t busy[NUM_REGS];
+    OpClass producers[NUM_REGS];
+};
+
+#endif
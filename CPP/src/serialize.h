@@ -0,0 +1,67 @@
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+// Raw binary helpers for checkpoint files. Values are written in host
+// byte order: checkpoints are meant to be restored on the machine (or at
+// least the architecture) that wrote them.
+
+template <class T>
+void put_pod(std::ostream& out, const T& value) {
+    out.write((const char*)&value, sizeof(T));
+}
+
+template <class T>
+bool get_pod(std::istream& in, T& value) {
+    return (bool)in.read((char*)&value, sizeof(T));
+}
+
+template <class T>
+void put_vector(std::ostream& out, const std::vector<T>& values) {
+    uint64_t count = values.size();
+    put_pod(out, count);
+    out.write((const char*)values.data(), count * sizeof(T));
+}
+
+// Bytes left in in, or -1 if it cannot seek
+inline std::streamoff remaining_bytes(std::istream& in) {
+    std::streampos here = in.tellg();
+    if (here == std::streampos(-1) || !in.seekg(0, std::ios::end)) {
+        return -1;
+    }
+    std::streamoff left = in.tellg() - here;
+    in.seekg(here);
+    return left;
+}
+
+// The count comes from the file, so it is checked against what is left
+// of it before anything is allocated
+template <class T>
+bool get_vector(std::istream& in, std::vector<T>& values) {
+    uint64_t count;
+    if (!get_pod(in, count)) {
+        return false;
+    }
+    std::streamoff left = remaining_bytes(in);
+    if (left < 0 || count > (uint64_t)left / sizeof(T)) {
+        return false;
+    }
+    values.resize(count);
+    return (bool)in.read((char*)values.data(), count * sizeof(T));
+}
+
+// Read a vector into one already sized for it: the saved length must match
+template <class T>
+bool get_sized_vector(std::istream& in, std::vector<T>& values) {
+    uint64_t count;
+    if (!get_pod(in, count) || count != values.size()) {
+        return false;
+    }
+    return (bool)in.read((char*)values.data(), count * sizeof(T));
+}
+
+#endif
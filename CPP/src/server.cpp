@@ -0,0 +1,634 @@
+#include "server.h"
+
+#include <cctype>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "engine.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Nesting allowed in a job; jobs are flat, this only stops runaway input
+static const int MAX_JSON_DEPTH = 32;
+
+// Just enough JSON for jobs. Numbers keep their source text, since the
+// only one a job has is its id, which is echoed back as it came.
+struct JsonValue {
+    enum Type { NUL, BOOL, NUMBER, STRING, ARRAY, OBJECT };
+
+    Type type = NUL;
+    bool boolean = false;
+    string text;   // STRING, or the digits of a NUMBER
+    vector<JsonValue> items;
+    vector<pair<string, JsonValue>> fields;
+
+    const JsonValue* field(const string& name) const {
+        for (const auto& f : fields) {
+            if (f.first == name) {
+                return &f.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser {
+public:
+    JsonParser(const char* begin, const char* end) : p(begin), end(end) {}
+
+    // Parse the whole input as one value
+    bool parse(JsonValue& value) {
+        if (!parse_value(value, 0)) {
+            return false;
+        }
+        skip_blanks();
+        return p == end || fail("trailing characters");
+    }
+
+    string error;
+
+private:
+    bool fail(const string& why) {
+        if (error.empty()) {
+            error = "bad JSON: " + why;
+        }
+        return false;
+    }
+
+    void skip_blanks() {
+        while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+            ++p;
+        }
+    }
+
+    bool literal(const char* word) {
+        size_t n = strlen(word);
+        if ((size_t)(end - p) < n || memcmp(p, word, n) != 0) {
+            return fail("unexpected characters");
+        }
+        p += n;
+        return true;
+    }
+
+    bool parse_value(JsonValue& value, int depth) {
+        skip_blanks();
+        if (p == end) {
+            return fail("unexpected end");
+        }
+        if (depth > MAX_JSON_DEPTH) {
+            return fail("nested too deeply");
+        }
+        switch (*p) {
+            case '{': return parse_object(value, depth);
+            case '[': return parse_array(value, depth);
+            case '"': value.type = JsonValue::STRING; return parse_string(value.text);
+            case 't': value.type = JsonValue::BOOL; value.boolean = true; return literal("true");
+            case 'f': value.type = JsonValue::BOOL; value.boolean = false; return literal("false");
+            case 'n': value.type = JsonValue::NUL; return literal("null");
+            default: return parse_number(value);
+        }
+    }
+
+    bool parse_number(JsonValue& value) {
+        const char* start = p;
+        while (p < end && (isdigit((unsigned char)*p) || *p == '-' || *p == '+' || *p == '.' || *p == 'e' ||
+                           *p == 'E')) {
+            ++p;
+        }
+        if (p == start) {
+            return fail("unexpected characters");
+        }
+        value.type = JsonValue::NUMBER;
+        value.text.assign(start, p);
+        return true;
+    }
+
+    static void append_utf8(string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += (char)code;
+        } else if (code < 0x800) {
+            out += (char)(0xc0 | (code >> 6));
+            out += (char)(0x80 | (code & 0x3f));
+        } else if (code < 0x10000) {
+            out += (char)(0xe0 | (code >> 12));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        } else {
+            out += (char)(0xf0 | (code >> 18));
+            out += (char)(0x80 | ((code >> 12) & 0x3f));
+            out += (char)(0x80 | ((code >> 6) & 0x3f));
+            out += (char)(0x80 | (code & 0x3f));
+        }
+    }
+
+    bool parse_hex4(uint32_t& code) {
+        if (end - p < 4) {
+            return fail("bad \\u escape");
+        }
+        code = 0;
+        for (int k = 0; k < 4; ++k, ++p) {
+            char c = (char)tolower((unsigned char)*p);
+            if (!isxdigit((unsigned char)c)) {
+                return fail("bad \\u escape");
+            }
+            code = code * 16 + (isdigit((unsigned char)c) ? c - '0' : c - 'a' + 10);
+        }
+        return true;
+    }
+
+    bool parse_string(string& out) {
+        ++p;   // opening quote
+        out.clear();
+        while (p < end && *p != '"') {
+            // Copy runs without escapes in one go; traces are long strings
+            const char* run = p;
+            while (p < end && *p != '"' && *p != '\\') {
+                ++p;
+            }
+            out.append(run, p);
+            if (p == end || *p == '"') {
+                break;
+            }
+            if (++p == end) {
+                break;
+            }
+            char c = *p++;
+            switch (c) {
+                case '"': case '\\': case '/': out += c; break;
+                case 'b': out += '\b'; break;
+                case 'f': out += '\f'; break;
+                case 'n': out += '\n'; break;
+                case 'r': out += '\r'; break;
+                case 't': out += '\t'; break;
+                case 'u': {
+                    uint32_t code;
+                    if (!parse_hex4(code)) {
+                        return false;
+                    }
+                    // A surrogate pair encodes one code point above 0xffff
+                    if (code >= 0xd800 && code < 0xdc00 && end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                        p += 2;
+                        uint32_t low;
+                        if (!parse_hex4(low) || low < 0xdc00 || low >= 0xe000) {
+                            return fail("bad surrogate pair");
+                        }
+                        code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                    }
+                    append_utf8(out, code);
+                    break;
+                }
+                default: return fail("bad escape");
+            }
+        }
+        if (p == end) {
+            return fail("unterminated string");
+        }
+        ++p;
+        return true;
+    }
+
+    bool parse_array(JsonValue& value, int depth) {
+        value.type = JsonValue::ARRAY;
+        ++p;
+        skip_blanks();
+        if (p < end && *p == ']') {
+            ++p;
+            return true;
+        }
+        while (true) {
+            value.items.emplace_back();
+            if (!parse_value(value.items.back(), depth + 1)) {
+                return false;
+            }
+            skip_blanks();
+            if (p < end && *p == ',') {
+                ++p;
+            } else if (p < end && *p == ']') {
+                ++p;
+                return true;
+            } else {
+                return fail("expected , or ]");
+            }
+        }
+    }
+
+    bool parse_object(JsonValue& value, int depth) {
+        value.type = JsonValue::OBJECT;
+        ++p;
+        skip_blanks();
+        if (p < end && *p == '}') {
+            ++p;
+            return true;
+        }
+        while (true) {
+            skip_blanks();
+            if (p == end || *p != '"') {
+                return fail("expected a field name");
+            }
+            value.fields.emplace_back();
+            if (!parse_string(value.fields.back().first)) {
+                return false;
+            }
+            skip_blanks();
+            if (p == end || *p != ':') {
+                return fail("expected :");
+            }
+            ++p;
+            if (!parse_value(value.fields.back().second, depth + 1)) {
+                return false;
+            }
+            skip_blanks();
+            if (p < end && *p == ',') {
+                ++p;
+            } else if (p < end && *p == '}') {
+                ++p;
+                return true;
+            } else {
+                return fail("expected , or }");
+            }
+        }
+    }
+
+    const char* p;
+    const char* end;
+};
+
+static uint64_t content_hash(const string& bytes) {
+    return hash<string>()(bytes) ^ ((uint64_t)bytes.size() * 0x9e3779b97f4a7c15ull);
+}
+
+shared_ptr<const Program> ProgramCache::find(uint64_t key, const string& bytes) {
+    lock_guard<mutex> guard(lock);
+    auto it = slots.find(key);
+    if (it == slots.end() || it->second.bytes != bytes) {
+        return nullptr;
+    }
+    ages.splice(ages.begin(), ages, it->second.age);
+    return it->second.program;
+}
+
+void ProgramCache::insert(uint64_t key, const string& bytes, shared_ptr<const Program> program) {
+    lock_guard<mutex> guard(lock);
+    if (capacity == 0) {
+        return;
+    }
+    auto it = slots.find(key);
+    if (it != slots.end()) {
+        // Another trace with the same hash gives way to the newer one
+        if (it->second.bytes != bytes) {
+            it->second.bytes = bytes;
+            it->second.program = program;
+        }
+        return;
+    }
+    if (slots.size() >= capacity) {
+        slots.erase(ages.back());
+        ages.pop_back();
+    }
+    ages.push_front(key);
+    slots[key] = Slot{bytes, program, ages.begin()};
+}
+
+shared_ptr<const Program> ProgramCache::get(const string& bytes, bool& cached, string& error) {
+    uint64_t key = content_hash(bytes);
+    shared_ptr<const Program> program = find(key, bytes);
+    cached = program != nullptr;
+    if (cached) {
+        return program;
+    }
+    // Decoded outside the lock; two jobs missing on the same trace at
+    // once both decode it, and the first to finish is kept
+    shared_ptr<Program> loaded(new Program);
+    if (!loaded->load_trace(bytes.data(), bytes.size(), error)) {
+        return nullptr;
+    }
+    insert(key, bytes, loaded);
+    return loaded;
+}
+
+shared_ptr<const Program> ProgramCache::get_file(const string& path, bool& cached, string& error) {
+    ifstream in(path, ios::binary);
+    if (!in) {
+        error = "Error opening " + path;
+        return nullptr;
+    }
+    string bytes((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    if (!is_elf_file(path)) {
+        return get(bytes, cached, error);
+    }
+    uint64_t key = content_hash(bytes);
+    shared_ptr<const Program> program = find(key, bytes);
+    cached = program != nullptr;
+    if (cached) {
+        return program;
+    }
+    shared_ptr<Program> loaded(new Program);
+    if (!loaded->load(path, error)) {
+        return nullptr;
+    }
+    insert(key, bytes, loaded);
+    return loaded;
+}
+
+namespace {
+
+// One client: where its jobs come from and where answers go. Answers are
+// written whole under the lock, since workers finish in any order. The
+// socket is closed once the reader and every job still running let go.
+struct Connection {
+    int in_fd;
+    int out_fd;
+    bool owns_fds;
+    mutex write_lock;
+    bool broken = false;
+
+    Connection(int in_fd, int out_fd, bool owns_fds) : in_fd(in_fd), out_fd(out_fd), owns_fds(owns_fds) {}
+    ~Connection() {
+        if (owns_fds) {
+            close(in_fd);
+        }
+    }
+
+    void send(const string& text) {
+        lock_guard<mutex> guard(write_lock);
+        size_t done = 0;
+        while (!broken && done < text.size()) {
+            ssize_t n = write(out_fd, text.data() + done, text.size() - done);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                broken = true;
+            } else {
+                done += (size_t)n;
+            }
+        }
+    }
+};
+
+struct Server {
+    PolicyKind policy;
+    SimConfig base;
+    ProgramCache cache;
+    ThreadPool pool;
+
+    Server(PolicyKind policy, const SimConfig& base, const ServerOptions& options)
+        : policy(policy), base(base), cache(options.program_cache), pool(options.jobs) {}
+};
+
+}  // namespace
+
+// Options that make a run write files. Clients must not pick paths on
+// the server's disk, and concurrent jobs would write over each other.
+static bool writes_files(const string& option) {
+    return option == "--events" || option == "--incremental" || option == "--checkpoint" ||
+           option == "--folded";
+}
+
+// Apply a job's "options" on top of config, the same way as the command line
+static bool apply_options(const JsonValue& options, SimConfig& config, string& error) {
+    if (options.type != JsonValue::ARRAY) {
+        error = "options must be a list of strings";
+        return false;
+    }
+    vector<string> args;
+    for (const auto& item : options.items) {
+        if (item.type != JsonValue::STRING) {
+            error = "options must be a list of strings";
+            return false;
+        }
+        args.push_back(item.text);
+    }
+    vector<char*> argv;
+    for (auto& arg : args) {
+        argv.push_back(&arg[0]);
+    }
+    int argc = (int)argv.size();
+    for (int a = 0; a < argc; ++a) {
+        string arg = args[a];
+        if (writes_files(arg)) {
+            error = arg + " is not allowed in a server job";
+            return false;
+        }
+        int handled = parse_config_option(argc, argv.data(), a, config);
+        if (handled < 0) {
+            error = "bad value for " + arg;
+            return false;
+        }
+        if (handled == 0) {
+            error = "unknown option " + arg;
+            return false;
+        }
+    }
+    return true;
+}
+
+static void write_timeline(ostream& out, const Simulation& sim) {
+    const Timeline& rows = sim.rows();
+    const uint32_t* words = sim.row_words();
+    out << ", \"timeline\": [";
+    for (size_t i = 0; i < rows.size(); ++i) {
+        char word[16];
+        snprintf(word, sizeof(word), "%08x", words[i]);
+        out << (i ? ", [\"" : "[\"") << word << "\"";
+        Stage last = rows.last_stage(i);
+        for (int s = 0; s < NUM_STAGES; ++s) {
+            out << ", ";
+            if (s <= last) {
+                out << rows.stage_cycle(i, (Stage)s);
+            } else {
+                out << "null";
+            }
+        }
+        if (last != STAGE_WB) {
+            out << ", \"squashed\"]";
+        } else {
+            out << ", " << rows.stall_cycles(i) << "]";
+        }
+    }
+    out << "]";
+}
+
+// The answer to a job, after its id. A job that is already known to be
+// bad only gets error back.
+static string run_job(Server& server, const JsonValue& job, string error) {
+    ostringstream out;
+    SimConfig config = server.base;
+    config.mode = OUTPUT_NONE;
+    PolicyKind policy = server.policy;
+    bool want_timeline = false;
+    shared_ptr<const Program> program;
+    bool cached = false;
+    if (error.empty()) {
+        const JsonValue* trace = job.field("trace");
+        const JsonValue* path = job.field("path");
+        const JsonValue* policy_name = job.field("policy");
+        const JsonValue* options = job.field("options");
+        const JsonValue* timeline = job.field("timeline");
+        want_timeline = timeline && timeline->type == JsonValue::BOOL && timeline->boolean;
+        if (policy_name && (policy_name->type != JsonValue::STRING || !parse_policy_kind(policy_name->text, policy))) {
+            error = "unknown policy";
+        } else if (options && !apply_options(*options, config, error)) {
+            // error says which option
+        } else if (!config.icache.valid() || !config.dcache.valid()) {
+            // The parser checks this too, but a bad geometry would take
+            // the whole server down, not just this job
+            error = "bad cache geometry";
+        } else if (want_timeline && config.sampling.enabled()) {
+            error = "timeline is not available with --sample";
+        } else if (trace && trace->type == JsonValue::STRING) {
+            program = server.cache.get(trace->text, cached, error);
+        } else if (path && path->type == JsonValue::STRING) {
+            program = server.cache.get_file(path->text, cached, error);
+        } else {
+            error = "a job needs a trace or a path";
+        }
+    }
+
+    if (program) {
+        config.keep_timeline = want_timeline;
+        unique_ptr<Simulation> sim(new Simulation(config));
+        if (run_with_policy(*sim, policy, program)) {
+            out << ", \"ok\": true, \"cached\": " << (cached ? "true" : "false") << ", \"counters\": {";
+            write_counters_fields(out, sim->counters());
+            out << "}";
+            if (want_timeline) {
+                write_timeline(out, *sim);
+            }
+            out << "}";
+            return out.str();
+        }
+        error = sim->error;
+    }
+    out << ", \"ok\": false, \"error\": ";
+    write_json_string(out, error);
+    out << "}";
+    return out.str();
+}
+
+// Run one job line and return its answer, without the newline
+static string handle_job(Server& server, const string& line) {
+    ostringstream out;
+    JsonValue job;
+    JsonParser parser(line.data(), line.data() + line.size());
+    bool parsed = parser.parse(job);
+
+    out << "{\"id\": ";
+    const JsonValue* id = parsed ? job.field("id") : nullptr;
+    if (id && id->type == JsonValue::STRING) {
+        write_json_string(out, id->text);
+    } else if (id && id->type == JsonValue::NUMBER) {
+        out << id->text;
+    } else {
+        out << "null";
+    }
+
+    string error = parser.error;
+    if (parsed && job.type != JsonValue::OBJECT) {
+        error = "a job must be a JSON object";
+    }
+    // Whatever goes wrong in one job is that job's answer; the others and
+    // the server carry on
+    try {
+        out << run_job(server, job, error);
+    } catch (const exception& e) {
+        out << ", \"ok\": false, \"error\": ";
+        write_json_string(out, string("internal error: ") + e.what());
+        out << "}";
+    }
+    return out.str();
+}
+
+// Read job lines until the client hangs up, handing each to the pool
+static void serve_connection(Server& server, shared_ptr<Connection> connection) {
+    string pending;
+    size_t scanned = 0;
+    char buffer[1 << 16];
+    while (true) {
+        ssize_t n = read(connection->in_fd, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        pending.append(buffer, (size_t)n);
+        size_t start = 0;
+        size_t newline;
+        while ((newline = pending.find('\n', scanned)) != string::npos) {
+            string line = pending.substr(start, newline - start);
+            start = scanned = newline + 1;
+            if (line.find_first_not_of(" \t\r") == string::npos) {
+                continue;
+            }
+            server.pool.submit([&server, connection, line]() {
+                connection->send(handle_job(server, line) + "\n");
+            });
+        }
+        pending.erase(0, start);
+        scanned = pending.size();
+    }
+    if (pending.find_first_not_of(" \t\r") != string::npos) {
+        server.pool.submit([&server, connection, pending]() {
+            connection->send(handle_job(server, pending) + "\n");
+        });
+    }
+}
+
+int run_server(PolicyKind policy, const SimConfig& base, const ServerOptions& options) {
+    // A client that hangs up early must not take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+    // Connection threads share it, since they can outlive this function
+    shared_ptr<Server> server = make_shared<Server>(policy, base, options);
+
+    if (options.socket_path == "-") {
+        serve_connection(*server, make_shared<Connection>(STDIN_FILENO, STDOUT_FILENO, false));
+        server->pool.wait();
+        return 0;
+    }
+
+    sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (options.socket_path.size() >= sizeof(address.sun_path)) {
+        cerr << "Socket path is too long: " << options.socket_path << endl;
+        return 1;
+    }
+    strcpy(address.sun_path, options.socket_path.c_str());
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    unlink(options.socket_path.c_str());
+    if (listener < 0 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        cerr << "Cannot listen on " << options.socket_path << ": " << strerror(errno) << endl;
+        return 1;
+    }
+    cerr << "Serving on " << options.socket_path << " with " << server->pool.size() << " workers" << endl;
+    while (true) {
+        int client = accept(listener, nullptr, nullptr);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            cerr << "accept: " << strerror(errno) << endl;
+            close(listener);
+            return 1;
+        }
+        shared_ptr<Connection> connection = make_shared<Connection>(client, client, true);
+        thread([server, connection]() { serve_connection(*server, connection); }).detach();
+    }
+}
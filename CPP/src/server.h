@@ -0,0 +1,80 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "hazard_policy.h"
+
+struct Program;
+struct SimConfig;
+
+// Simulation server (--serve): a long-lived process that takes jobs as
+// JSON, one per line, and answers each with one line of JSON, so tools
+// pay for process startup and trace decoding once instead of per query.
+//
+// A job is an object with these fields (all optional but the trace):
+//   "id"        echoed back, to match answers to jobs
+//   "trace"     the trace as hex text, one word per line
+//   "path"      or a trace or ELF file to load instead
+//   "policy"    forwarding, none, bypass or alu-bypass
+//   "options"   simulator options as a list of strings, e.g.
+//               ["--load-latency", "2", "--execute"]; options that write
+//               files (--events, --incremental, --checkpoint, --folded)
+//               are refused
+//   "timeline"  true to return the row of every instruction
+// The answer holds "id", "ok", "cached" (the program was already
+// decoded), the counters, and "timeline" as [word, IF, ID, EXE, MEM, WB,
+// stalls] rows (null for stages a squashed row never reached, and
+// "squashed" for its stalls), or "error" when ok is false. Jobs run
+// concurrently, so answers can come back in a different order.
+
+const size_t DEFAULT_PROGRAM_CACHE = 64;
+const size_t MAX_PROGRAM_CACHE = 1 << 16;
+
+struct ServerOptions {
+    std::string socket_path = "-";   // "-" serves stdin and stdout
+    unsigned jobs = 0;               // worker threads, 0: one per core
+    size_t program_cache = DEFAULT_PROGRAM_CACHE;
+};
+
+// Decoded programs by a hash of their bytes, least recently used first
+// out. Each entry keeps the bytes too, so a hash collision is a miss
+// rather than the wrong program. Shared by every connection and worker.
+class ProgramCache {
+public:
+    explicit ProgramCache(size_t capacity) : capacity(capacity) {}
+
+    // The program for a trace held in memory, decoding it on a miss
+    std::shared_ptr<const Program> get(const std::string& bytes, bool& cached, std::string& error);
+    // The program in a file; the file is still read on every call, to
+    // hash what it holds now
+    std::shared_ptr<const Program> get_file(const std::string& path, bool& cached, std::string& error);
+
+private:
+    struct Slot {
+        std::string bytes;
+        std::shared_ptr<const Program> program;
+        std::list<uint64_t>::iterator age;
+    };
+
+    std::shared_ptr<const Program> find(uint64_t key, const std::string& bytes);
+    void insert(uint64_t key, const std::string& bytes, std::shared_ptr<const Program> program);
+
+    size_t capacity;
+    std::mutex lock;
+    std::unordered_map<uint64_t, Slot> slots;
+    std::list<uint64_t> ages;   // most recently used at the front
+};
+
+// Serve jobs until standard input ends (socket "-") or forever on a Unix
+// domain socket. Jobs start from base, with their options on top, and use
+// policy unless they name another. Returns the process exit status.
+int run_server(PolicyKind policy, const SimConfig& base, const ServerOptions& options);
+
+#endif
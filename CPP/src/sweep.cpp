@@ -0,0 +1,269 @@
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "engine.h"
+#include "thread_pool.h"
+
+using namespace std;
+
+// Design-space sweep: decode a trace once, then simulate every combination
+// of the listed settings on a thread pool and print cycles/CPI for each.
+//
+//   sweep [--policy forwarding,none,bypass,alu-bypass] [--load-latency 0,1,2]
+//         [--mem-latency 10,50] [--icache off,4k:2:32] [--dcache ...]
+//         [--predictor not-taken,gshare] [--width 1,2,4] [--rob 0,32,128]
+//         [--jobs n] [--json file] [other simulator options] <trace>
+//
+// Options not listed above take a single value and apply to every point.
+// A ROB size of 0 means the in-order pipeline, anything else the
+// out-of-order backend.
+
+struct SweepPoint {
+    PolicyKind policy;
+    SimConfig config;
+    string icache_label;
+    string dcache_label;
+    PerfCounters counters;
+    bool ok = false;
+    string error;
+};
+
+static vector<string> split_list(const string& text) {
+    vector<string> items;
+    size_t start = 0;
+    while (true) {
+        size_t comma = text.find(',', start);
+        items.push_back(text.substr(start, comma - start));
+        if (comma == string::npos) break;
+        start = comma + 1;
+    }
+    return items;
+}
+
+static bool parse_int_list(const string& text, vector<int>& values) {
+    values.clear();
+    for (const auto& item : split_list(text)) {
+        char* end;
+        long n = strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || n < 0) {
+            return false;
+        }
+        values.push_back((int)n);
+    }
+    return true;
+}
+
+// "off" disables the cache at that point of the sweep
+static bool parse_cache_list(const string& text, vector<pair<string, CacheConfig>>& caches) {
+    caches.clear();
+    for (const auto& item : split_list(text)) {
+        CacheConfig config;
+        if (item != "off" && !parse_cache_config(item, config)) {
+            return false;
+        }
+        caches.push_back(make_pair(item, config));
+    }
+    return true;
+}
+
+static string rob_label(const SimConfig& config) {
+    return config.ooo.enabled ? to_string(config.ooo.rob_size) : "-";
+}
+
+static void print_results(const vector<SweepPoint>& points) {
+    cout << left << setw(12) << "Policy" << setw(7) << "Width" << setw(6) << "ROB" << setw(6) << "Load" << setw(6) << "Mem"
+         << setw(16) << "I-cache" << setw(16) << "D-cache" << setw(11) << "Predictor"
+         << right << setw(12) << "Cycles" << setw(14) << "Instructions" << setw(8) << "CPI" << "\n";
+    for (const auto& p : points) {
+        cout << left << setw(12) << policy_kind_name(p.policy) << setw(7) << p.config.issue_width
+             << setw(6) << rob_label(p.config) << setw(6) << p.config.load_latency << setw(6) << p.config.memory_latency << setw(16) << p.icache_label << setw(16) << p.dcache_label
+             << setw(11) << predictor_kind_name(p.config.predictor.kind) << right;
+        if (!p.ok) {
+            cout << "  " << p.error << "\n";
+            continue;
+        }
+        cout << setw(12) << p.counters.cycles << setw(14) << p.counters.instructions
+             << setw(8) << fixed << setprecision(3) << p.counters.cpi() << "\n";
+    }
+    cout.flush();
+}
+
+static bool write_json(const string& path, const vector<SweepPoint>& points) {
+    ofstream file;
+    if (path != "-") {
+        file.open(path);
+        if (!file) {
+            cerr << "Cannot write " << path << endl;
+            return false;
+        }
+    }
+    ostream& out = path == "-" ? cout : file;
+    out << "[\n";
+    for (size_t k = 0; k < points.size(); ++k) {
+        const SweepPoint& p = points[k];
+        out << "  {\"policy\": \"" << policy_kind_name(p.policy) << "\", \"width\": "
+            << p.config.issue_width << ", \"rob\": " << (p.config.ooo.enabled ? p.config.ooo.rob_size : 0)
+            << ", \"load_latency\": "
+            << p.config.load_latency << ", \"mem_latency\": " << p.config.memory_latency
+            << ", \"icache\": ";
+        write_json_string(out, p.icache_label);
+        out << ", \"dcache\": ";
+        write_json_string(out, p.dcache_label);
+        out << ", \"predictor\": \"" << predictor_kind_name(p.config.predictor.kind) << "\", ";
+        if (p.ok) {
+            write_counters_fields(out, p.counters);
+        } else {
+            out << "\"error\": ";
+            write_json_string(out, p.error);
+        }
+        out << (k + 1 < points.size() ? "},\n" : "}\n");
+    }
+    out << "]\n";
+    out.flush();
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    SimConfig base;
+    vector<PolicyKind> policies = {PolicyKind::FORWARDING, PolicyKind::NONE};
+    vector<int> widths = {1};
+    vector<int> rob_sizes;
+    vector<int> load_latencies = {0};
+    vector<int> memory_latencies = {DEFAULT_MEMORY_LATENCY};
+    vector<pair<string, CacheConfig>> icaches = {make_pair(string("off"), CacheConfig())};
+    vector<pair<string, CacheConfig>> dcaches = icaches;
+    vector<PredictorKind> predictors;
+    unsigned jobs = 0;
+    string json_path;
+    string input_path = "input.txt";
+
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        bool has_value = a + 1 < argc;
+        bool ok = true;
+        if (arg == "--policy" && has_value) {
+            policies.clear();
+            for (const auto& name : split_list(argv[++a])) {
+                PolicyKind kind;
+                ok = ok && parse_policy_kind(name, kind);
+                policies.push_back(kind);
+            }
+        } else if (arg == "--width" && has_value) {
+            ok = parse_int_list(argv[++a], widths);
+            for (int width : widths) {
+                ok = ok && width >= 1 && width <= 16;
+            }
+        } else if (arg == "--rob" && has_value) {
+            ok = parse_int_list(argv[++a], rob_sizes);
+            for (int size : rob_sizes) {
+                ok = ok && size <= 4096;
+            }
+        } else if ((arg == "--load-latency" || arg == "--mem-latency") && has_value) {
+            vector<int>& latencies = arg == "--load-latency" ? load_latencies : memory_latencies;
+            ok = parse_int_list(argv[++a], latencies);
+            for (int latency : latencies) {
+                ok = ok && latency <= MAX_MEMORY_LATENCY;
+            }
+        } else if (arg == "--icache" && has_value) {
+            ok = parse_cache_list(argv[++a], icaches);
+        } else if (arg == "--dcache" && has_value) {
+            ok = parse_cache_list(argv[++a], dcaches);
+        } else if (arg == "--predictor" && has_value) {
+            predictors.clear();
+            for (const auto& name : split_list(argv[++a])) {
+                PredictorKind kind;
+                ok = ok && parse_predictor_kind(name, kind);
+                predictors.push_back(kind);
+            }
+        } else if (arg == "--jobs" && has_value) {
+            uint64_t count = 0;
+            ok = parse_count(argv[++a], 0, MAX_JOBS, count);
+            jobs = (unsigned)count;
+        } else if (arg == "--json" && has_value) {
+            json_path = argv[++a];
+        } else {
+            int handled = parse_config_option(argc, argv, a, base);
+            if (handled < 0) {
+                return 1;
+            }
+            if (handled == 0) {
+                input_path = arg;
+            }
+        }
+        if (!ok) {
+            cerr << "Bad value for " << arg << ": " << argv[a] << endl;
+            return 1;
+        }
+    }
+    if (const char* shared = shared_output_option(base)) {
+        cerr << shared << " cannot be used with sweep: every point would write the same file" << endl;
+        return 1;
+    }
+    if (rob_sizes.empty()) {
+        rob_sizes.push_back(base.ooo.enabled ? (int)base.ooo.rob_size : 0);
+    }
+    if (predictors.empty()) {
+        predictors.push_back(base.predictor.kind);
+    }
+    base.mode = OUTPUT_NONE;
+
+    shared_ptr<Program> loaded(new Program);
+    string error;
+    if (!loaded->load(input_path, error)) {
+        cerr << error << endl;
+        return 1;
+    }
+    shared_ptr<const Program> program = loaded;
+
+    vector<SweepPoint> points;
+    for (PolicyKind policy : policies)
+    for (int width : widths)
+    for (int rob_size : rob_sizes)
+    for (int load_latency : load_latencies)
+    for (int memory_latency : memory_latencies)
+    for (const auto& icache : icaches)
+    for (const auto& dcache : dcaches)
+    for (PredictorKind predictor : predictors) {
+        SweepPoint p;
+        p.policy = policy;
+        p.config = base;
+        p.config.issue_width = width;
+        p.config.ooo.enabled = rob_size > 0;
+        if (rob_size > 0) {
+            p.config.ooo.rob_size = rob_size;
+        }
+        p.config.load_latency = load_latency;
+        p.config.memory_latency = memory_latency;
+        p.config.icache = icache.second;
+        p.config.dcache = dcache.second;
+        p.config.predictor.kind = predictor;
+        p.icache_label = icache.first;
+        p.dcache_label = dcache.first;
+        points.push_back(p);
+    }
+
+    {
+        ThreadPool pool(jobs);
+        for (auto& p : points) {
+            SweepPoint* point = &p;
+            pool.submit([point, program] {
+                unique_ptr<Simulation> sim(new Simulation(point->config));
+                point->ok = run_with_policy(*sim, point->policy, program);
+                point->error = sim->error;
+                point->counters = sim->counters();
+            });
+        }
+        pool.wait();
+    }
+
+    print_results(points);
+    if (!json_path.empty() && !write_json(json_path, points)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "thread_pool.h"
+
+using namespace std;
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0) {
+        threads = thread::hardware_concurrency();
+        if (threads == 0) {
+            threads = 1;
+        }
+    }
+    for (unsigned t = 0; t < threads; ++t) {
+        queues.emplace_back(new Queue);
+    }
+    for (unsigned t = 0; t < threads; ++t) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, t);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    wait();
+    {
+        lock_guard<mutex> guard(state_lock);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (auto& w : workers) {
+        w.join();
+    }
+}
+
+void ThreadPool::submit(function<void()> task) {
+    Queue& q = *queues[next_queue++ % queues.size()];
+    {
+        // Counted under state_lock so a worker about to sleep sees it, and
+        // before the task is visible so a worker that takes and finishes
+        // it at once cannot take the counts below zero
+        lock_guard<mutex> guard(state_lock);
+        queued += 1;
+        unfinished += 1;
+    }
+    {
+        lock_guard<mutex> guard(q.lock);
+        q.tasks.push_back(move(task));
+    }
+    work_ready.notify_one();
+}
+
+void ThreadPool::wait() {
+    unique_lock<mutex> guard(state_lock);
+    all_done.wait(guard, [this] { return unfinished == 0; });
+}
+
+// Own deque first (newest task), then the oldest task of each other deque
+bool ThreadPool::take(unsigned id, function<void()>& task) {
+    for (unsigned k = 0; k < queues.size(); ++k) {
+        Queue& q = *queues[(id + k) % queues.size()];
+        lock_guard<mutex> guard(q.lock);
+        if (q.tasks.empty()) {
+            continue;
+        }
+        if (k == 0) {
+            task = move(q.tasks.back());
+            q.tasks.pop_back();
+        } else {
+            task = move(q.tasks.front());
+            q.tasks.pop_front();
+        }
+        queued -= 1;
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::worker_loop(unsigned id) {
+    while (true) {
+        function<void()> task;
+        if (take(id, task)) {
+            task();
+            lock_guard<mutex> guard(state_lock);
+            if (--unfinished == 0) {
+                all_done.notify_all();
+            }
+            continue;
+        }
+        unique_lock<mutex> guard(state_lock);
+        work_ready.wait(guard, [this] { return stopping || queued > 0; });
+        if (stopping && queued == 0) {
+            return;
+        }
+    }
+}
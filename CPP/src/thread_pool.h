@@ -0,0 +1,55 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads, each with its own task deque. A worker
+// takes tasks from the back of its own deque and, when that is empty,
+// steals from the front of the others, so long-running tasks on one
+// thread do not leave the rest idle.
+class ThreadPool {
+public:
+    // threads == 0 uses one thread per hardware core
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    void submit(std::function<void()> task);
+
+    // Block until every submitted task has finished.
+    void wait();
+
+    unsigned size() const { return (unsigned)workers.size(); }
+
+private:
+    struct Queue {
+        std::mutex lock;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void worker_loop(unsigned id);
+    bool take(unsigned id, std::function<void()>& task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex state_lock;
+    std::condition_variable work_ready;
+    std::condition_variable all_done;
+    std::atomic<size_t> queued{0};   // submitted but not yet taken
+    size_t unfinished = 0;           // submitted but not yet finished
+    bool stopping = false;
+    std::atomic<unsigned> next_queue{0};
+};
+
+#endif
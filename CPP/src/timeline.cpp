@@ -0,0 +1,106 @@
+#include "timeline.h"
+
+using namespace std;
+
+static const char* const stage_names[NUM_STAGES] = {"IF", "ID", "EXE", "MEM", "WB"};
+// Stages of squashed instructions are shown in lower case
+static const char* const squashed_names[NUM_STAGES] = {"if", "id", "exe", "mem", "wb"};
+
+void Timeline::enter(size_t i, Stage stage, int cycle) {
+    TimelineEntry& e = entries[i & mask];
+    if (stage == STAGE_IF) {
+        e.if_cycle = cycle;
+        for (int s = 0; s < NUM_STAGES - 1; ++s) {
+            e.stalls[s] = 0;
+        }
+        return;
+    }
+    int prev = stage_cycle(i, (Stage)(stage - 1));
+    e.stalls[stage - 1] = (uint32_t)(cycle - prev - 1);
+}
+
+void Timeline::squash(size_t i, int cycle) {
+    TimelineEntry& e = entries[i & mask];
+    int stage_start = e.if_cycle;
+    for (int s = 0; s < NUM_STAGES - 1; ++s) {
+        int next = stage_start + 1 + e.stalls[s];
+        if (next > cycle) {
+            e.stalls[s] = SQUASHED;
+            return;
+        }
+        stage_start = next;
+    }
+}
+
+Stage Timeline::last_stage(size_t i) const {
+    const TimelineEntry& e = entries[i & mask];
+    for (int s = 0; s < NUM_STAGES - 1; ++s) {
+        if (e.stalls[s] == SQUASHED) {
+            return (Stage)s;
+        }
+    }
+    return STAGE_WB;
+}
+
+int Timeline::stage_cycle(size_t i, Stage stage) const {
+    const TimelineEntry& e = entries[i & mask];
+    int cycle = e.if_cycle;
+    for (int s = 0; s < stage; ++s) {
+        cycle += 1 + e.stalls[s];
+    }
+    return cycle;
+}
+
+int Timeline::stall_cycles(size_t i) const {
+    const TimelineEntry& e = entries[i & mask];
+    int total = 0;
+    for (int s = 0; s < NUM_STAGES - 1 && e.stalls[s] != SQUASHED; ++s) {
+        total += e.stalls[s];
+    }
+    return total;
+}
+
+bool Timeline::is_stalled(size_t i, int cycle) const {
+    const TimelineEntry& e = entries[i & mask];
+    int stage_start = e.if_cycle;
+    for (int s = 0; s < NUM_STAGES - 1 && e.stalls[s] != SQUASHED; ++s) {
+        if (cycle <= stage_start) {
+            return false;
+        }
+        if (cycle <= stage_start + (int)e.stalls[s]) {
+            return true;
+        }
+        stage_start += 1 + e.stalls[s];
+    }
+    return false;
+}
+
+const char* Timeline::cell(size_t i, int cycle) const {
+    const TimelineEntry& e = entries[i & mask];
+    const char* const* names = is_squashed(i) ? squashed_names : stage_names;
+    int stage_start = e.if_cycle;
+    for (int s = 0; s < NUM_STAGES; ++s) {
+        if (cycle < stage_start) {
+            return s == 0 ? " " : "-";
+        }
+        if (cycle == stage_start) {
+            return names[s];
+        }
+        if (s == NUM_STAGES - 1 || e.stalls[s] == SQUASHED) {
+            break;
+        }
+        stage_start += 1 + e.stalls[s];
+    }
+    return " ";
+}
+
+int Timeline::total_cycles() const {
+    int max_cycle = 0;
+    for (size_t i = 0; i < entries.size(); ++i) {
+        int end = end_cycle(i);
+        if (end > max_cycle) {
+            max_cycle = end;
+        }
+    }
+    return max_cycle;
+}
@@ -0,0 +1,83 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+enum Stage {
+    STAGE_IF,
+    STAGE_ID,
+    STAGE_EXE,
+    STAGE_MEM,
+    STAGE_WB,
+    NUM_STAGES
+};
+
+// Per-instruction timing: the cycle the instruction entered IF and the
+// number of stall cycles spent after each stage before the next one.
+// Every other stage cycle is derived from these. A wrong-path instruction
+// flushed after stage s has stalls[s] == SQUASHED and no later stages.
+const uint32_t SQUASHED = 0xffffffff;
+
+struct TimelineEntry {
+    uint32_t if_cycle;
+    // 32 bits: out-of-order waits can run to millions of cycles
+    uint32_t stalls[NUM_STAGES - 1];
+};
+
+// Compact replacement for the old vector<vector<string>> output table.
+// Memory is linear in the number of instructions; the printable grid is
+// derived on demand by cell().
+//
+// In ring mode only the most recent entries are kept (capacity must be a
+// power of two) and instruction i lives in slot i & (capacity - 1). This
+// is what streaming simulation uses, since hazards only look back at i-1.
+class Timeline {
+public:
+    void resize(size_t n) {
+        entries.assign(n, TimelineEntry());
+        mask = ~(size_t)0;
+    }
+    void resize_ring(size_t capacity) {
+        entries.assign(capacity, TimelineEntry());
+        mask = capacity - 1;
+    }
+    size_t size() const { return entries.size(); }
+
+    // Add a slot at the end (not in ring mode), for runs of unknown length.
+    void append() { entries.push_back(TimelineEntry()); }
+
+    // Raw access to instruction i's entry, for saving and splicing whole
+    // timelines
+    const TimelineEntry& entry(size_t i) const { return entries[i & mask]; }
+    void set_entry(size_t i, const TimelineEntry& e) { entries[i & mask] = e; }
+
+    // Record that instruction i entered the given stage at cycle.
+    void enter(size_t i, Stage stage, int cycle);
+
+    // Flush instruction i: drop every stage it would enter after cycle.
+    void squash(size_t i, int cycle);
+
+    bool is_squashed(size_t i) const { return last_stage(i) != STAGE_WB; }
+    Stage last_stage(size_t i) const;
+
+    int stage_cycle(size_t i, Stage stage) const;
+    int end_cycle(size_t i) const { return stage_cycle(i, last_stage(i)); }
+    int stall_cycles(size_t i) const;
+
+    // True if instruction i shows a stall ("-") in the given cycle.
+    bool is_stalled(size_t i, int cycle) const;
+
+    // Text of the grid cell for instruction i in the given (1-based) cycle.
+    const char* cell(size_t i, int cycle) const;
+
+    // Last cycle used by any instruction.
+    int total_cycles() const;
+
+private:
+    std::vector<TimelineEntry> entries;
+    size_t mask = ~(size_t)0;
+};
+
+#endif
@@ -0,0 +1,358 @@
+#include "trace_loader.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+static const size_t STREAM_BUFFER_SIZE = 1 << 16;
+
+static inline int hex_value(unsigned char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    return -1;
+}
+
+// Printable and not a blank, i.e. part of the instruction text
+static inline bool is_text(unsigned char c) {
+    return c > ' ' && c < 0x7f;
+}
+
+static inline uint32_t from_little_endian(uint32_t word) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    return __builtin_bswap32(word);
+#else
+    return word;
+#endif
+}
+
+// Header fields are stored little-endian like the words
+static inline void swap_header(BinaryTraceHeader& header) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    header.version = __builtin_bswap32(header.version);
+    header.count = __builtin_bswap64(header.count);
+#else
+    (void)header;
+#endif
+}
+
+bool parse_hex_line(const char* begin, const char* end, uint32_t& word) {
+    const char* p = begin;
+    while (p < end && !is_text(*p)) {
+        ++p;
+    }
+    if (p == end) {
+        return false;
+    }
+    if (end - p >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+        p += 2;
+    }
+    uint32_t value = 0;
+    for (; p < end; ++p) {
+        int d = hex_value(*p);
+        if (d < 0) break;
+        value = (value << 4) | (uint32_t)d;
+    }
+    word = value;
+    return true;
+}
+
+// Byte masks for the 8-character fast path, one byte per character
+static const uint64_t ONES = 0x0101010101010101ull;
+static const uint64_t HIGH_BITS = 0x8080808080808080ull;
+
+// High bit of each byte set where that byte is >= k. Bytes must be below
+// 0x80, so setting the high bit first keeps borrows inside the byte.
+static inline uint64_t bytes_at_least(uint64_t x, uint8_t k) {
+    return ((x | HIGH_BITS) - ONES * k) & HIGH_BITS;
+}
+
+// The value of eight hex digits, or false if any byte is not a hex digit.
+// All eight are checked and converted at once in a 64-bit register.
+static inline bool parse_hex8(const char* p, uint32_t& word) {
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    x = __builtin_bswap64(x);
+#endif
+    if (x & HIGH_BITS) {
+        return false;
+    }
+    uint64_t lower = x | (ONES * 0x20);   // digits already have 0x20 set
+    uint64_t digit = bytes_at_least(x, '0') & ~bytes_at_least(x, '9' + 1);
+    uint64_t letter = bytes_at_least(lower, 'a') & ~bytes_at_least(lower, 'f' + 1);
+    if ((digit | letter) != HIGH_BITS) {
+        return false;
+    }
+    // '0'-'9' and 'a'-'f' / 'A'-'F' keep their value in the low nibble,
+    // letters counting from 1
+    uint64_t nibbles = (x & (ONES * 0x0f)) + (letter >> 7) * 9;
+    // First character in the low byte: fold pairs of nibbles into bytes,
+    // then gather every other byte, then put the first byte on top
+    uint64_t bytes = ((nibbles & 0x000f000f000f000full) << 4) | ((nibbles >> 8) & 0x000f000f000f000full);
+    bytes = (bytes | (bytes >> 8)) & 0x0000ffff0000ffffull;
+    bytes = (bytes | (bytes >> 16)) & 0xffffffffull;
+    word = __builtin_bswap32((uint32_t)bytes);
+    return true;
+}
+
+void parse_hex_text(const char* begin, const char* end, vector<uint32_t>& words) {
+    // Most traces have one 8-digit word per line; estimate from that
+    words.reserve(words.size() + (end - begin) / 9 + 1);
+    const char* p = begin;
+    while (p < end) {
+        uint32_t word;
+        if (end - p > 9 && parse_hex8(p, word)) {
+            if (p[8] == '\n') {
+                words.push_back(word);
+                p += 9;
+                continue;
+            }
+            if (p[8] == '\r' && p[9] == '\n') {
+                words.push_back(word);
+                p += 10;
+                continue;
+            }
+        }
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) {
+            eol = end;
+        }
+        if (parse_hex_line(p, eol, word)) {
+            words.push_back(word);
+        }
+        p = eol + 1;
+    }
+}
+
+bool is_binary_trace(const char* data, size_t size) {
+    return size >= sizeof(BinaryTraceHeader) && memcmp(data, TRACE_MAGIC, 4) == 0;
+}
+
+bool TraceFile::open(const string& path) {
+    close();
+
+    if (path == "-") {
+        vector<char> bytes;
+        char chunk[STREAM_BUFFER_SIZE];
+        size_t n;
+        while ((n = fread(chunk, 1, sizeof(chunk), stdin)) > 0) {
+            bytes.insert(bytes.end(), chunk, chunk + n);
+        }
+        return parse(bytes.data(), bytes.size());
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error_message = "Error opening " + path;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        error_message = "Error reading " + path;
+        return false;
+    }
+    if (st.st_size == 0) {
+        ::close(fd);
+        return true;
+    }
+    mapping_size = st.st_size;
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        error_message = "Error mapping " + path;
+        return false;
+    }
+    madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+    return load((const char*)mapping, mapping_size);
+}
+
+bool TraceFile::parse(const char* bytes, size_t size) {
+    close();
+    // The buffer is temporary, so keep our own copy of the words
+    bool ok = load(bytes, size);
+    if (ok && words != owned.data()) {
+        owned.assign(words, words + count);
+        words = owned.data();
+    }
+    return ok;
+}
+
+bool TraceFile::load(const char* bytes, size_t size) {
+    if (!is_binary_trace(bytes, size)) {
+        parse_hex_text(bytes, bytes + size, owned);
+        words = owned.data();
+        count = owned.size();
+        return true;
+    }
+
+    binary = true;
+    BinaryTraceHeader header;
+    memcpy(&header, bytes, sizeof(header));
+    swap_header(header);
+    if (header.version != TRACE_VERSION) {
+        error_message = "Unsupported binary trace version";
+        return false;
+    }
+    size_t available = (size - sizeof(header)) / sizeof(uint32_t);
+    if (header.count > available) {
+        error_message = "Binary trace is truncated";
+        return false;
+    }
+    count = header.count;
+    const uint32_t* raw = (const uint32_t*)(bytes + sizeof(header));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    owned.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        owned[i] = from_little_endian(raw[i]);
+    }
+    words = owned.data();
+#else
+    words = raw;
+#endif
+    return true;
+}
+
+void TraceFile::close() {
+    if (mapping) {
+        munmap(mapping, mapping_size);
+        mapping = nullptr;
+        mapping_size = 0;
+    }
+    owned.clear();
+    words = nullptr;
+    count = 0;
+    binary = false;
+}
+
+TraceStream::~TraceStream() {
+    if (file && file != stdin) {
+        fclose(file);
+    }
+}
+
+bool TraceStream::open(const string& path) {
+    if (path == "-") {
+        file = stdin;
+    } else {
+        file = fopen(path.c_str(), "rb");
+        if (!file) {
+            error_message = "Error opening " + path;
+            return false;
+        }
+    }
+    buffer.resize(STREAM_BUFFER_SIZE);
+
+    while (len < sizeof(BinaryTraceHeader) && fill()) {
+    }
+    if (is_binary_trace(buffer.data(), len)) {
+        BinaryTraceHeader header;
+        memcpy(&header, buffer.data(), sizeof(header));
+        swap_header(header);
+        if (header.version != TRACE_VERSION) {
+            error_message = "Unsupported binary trace version";
+            return false;
+        }
+        binary = true;
+        pos = sizeof(header);
+    }
+    return true;
+}
+
+// Move unread bytes to the front and read more. Returns false at EOF.
+bool TraceStream::fill() {
+    if (eof) {
+        return false;
+    }
+    if (pos > 0) {
+        memmove(buffer.data(), buffer.data() + pos, len - pos);
+        len -= pos;
+        pos = 0;
+    }
+    if (len == buffer.size()) {
+        buffer.resize(buffer.size() * 2);
+    }
+    size_t n = fread(buffer.data() + len, 1, buffer.size() - len, file);
+    if (n == 0) {
+        eof = true;
+        return false;
+    }
+    len += n;
+    return true;
+}
+
+bool TraceStream::next(uint32_t& word) {
+    if (binary) {
+        while (len - pos < sizeof(uint32_t)) {
+            if (!fill()) {
+                return false;
+            }
+        }
+        uint32_t raw;
+        memcpy(&raw, buffer.data() + pos, sizeof(raw));
+        pos += sizeof(raw);
+        word = from_little_endian(raw);
+        return true;
+    }
+
+    while (true) {
+        const char* start = buffer.data() + pos;
+        if (len - pos > 9 && parse_hex8(start, word) && start[8] == '\n') {
+            pos += 9;
+            return true;
+        }
+        const char* eol = (const char*)memchr(start, '\n', len - pos);
+        if (!eol && fill()) {
+            continue;
+        }
+        if (!eol && pos == len) {
+            return false;
+        }
+        const char* end = eol ? eol : buffer.data() + len;
+        start = buffer.data() + pos;
+        pos = eol ? (end - buffer.data()) + 1 : len;
+        if (parse_hex_line(start, end, word)) {
+            return true;
+        }
+    }
+}
+
+bool write_binary_trace(const string& path, const uint32_t* words, size_t count) {
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) {
+        return false;
+    }
+    BinaryTraceHeader header;
+    memcpy(header.magic, TRACE_MAGIC, 4);
+    header.version = TRACE_VERSION;
+    header.count = count;
+    swap_header(header);
+    bool ok = fwrite(&header, sizeof(header), 1, out) == 1;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t i = 0; ok && i < count; ++i) {
+        uint32_t raw = from_little_endian(words[i]);
+        ok = fwrite(&raw, sizeof(raw), 1, out) == 1;
+    }
+#else
+    ok = ok && fwrite(words, sizeof(uint32_t), count, out) == count;
+#endif
+    return fclose(out) == 0 && ok;
+}
+
+bool write_text_trace(const string& path, const uint32_t* words, size_t count) {
+    FILE* out = fopen(path.c_str(), "w");
+    if (!out) {
+        return false;
+    }
+    bool ok = true;
+    for (size_t i = 0; ok && i < count; ++i) {
+        ok = fprintf(out, "%08x\n", words[i]) > 0;
+    }
+    return fclose(out) == 0 && ok;
+}
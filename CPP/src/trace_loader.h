@@ -0,0 +1,92 @@
+#ifndef TRACE_LOADER_H
+#define TRACE_LOADER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// Binary trace format: this header followed by `count` little-endian
+// 32-bit instruction words.
+struct BinaryTraceHeader {
+    char magic[4];   // "RVTR"
+    uint32_t version;
+    uint64_t count;
+};
+
+const char TRACE_MAGIC[4] = {'R', 'V', 'T', 'R'};
+const uint32_t TRACE_VERSION = 1;
+
+// Parse one text line in place. Non-printable characters and surrounding
+// blanks are ignored; blank lines yield false. The word is taken from the
+// leading hex digits (an optional 0x prefix is allowed), 0 if there are none.
+bool parse_hex_line(const char* begin, const char* end, uint32_t& word);
+
+// Parse every line of a hex text trace, appending the words.
+void parse_hex_text(const char* begin, const char* end, std::vector<uint32_t>& words);
+
+bool is_binary_trace(const char* data, size_t size);
+
+// A whole trace held in memory. Files are mmapped; binary traces are used
+// straight from the mapping, text traces are parsed from it without
+// per-line allocations. "-" reads standard input instead.
+class TraceFile {
+public:
+    TraceFile() {}
+    ~TraceFile() { close(); }
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    bool open(const std::string& path);
+    // Use a trace that is already in memory, such as one received over a
+    // socket. The words are copied, so bytes need not outlive the call.
+    bool parse(const char* bytes, size_t size);
+    void close();
+
+    const uint32_t* data() const { return words; }
+    size_t size() const { return count; }
+    bool is_binary() const { return binary; }
+    const std::string& error() const { return error_message; }
+
+private:
+    bool load(const char* bytes, size_t size);
+
+    void* mapping = nullptr;
+    size_t mapping_size = 0;
+    const uint32_t* words = nullptr;
+    size_t count = 0;
+    bool binary = false;
+    std::vector<uint32_t> owned;
+    std::string error_message;
+};
+
+// Reads a trace incrementally through a fixed-size buffer, for --stream.
+// Accepts the same text and binary formats as TraceFile.
+class TraceStream {
+public:
+    TraceStream() {}
+    ~TraceStream();
+    TraceStream(const TraceStream&) = delete;
+    TraceStream& operator=(const TraceStream&) = delete;
+
+    bool open(const std::string& path);
+    bool next(uint32_t& word);
+    const std::string& error() const { return error_message; }
+
+private:
+    bool fill();
+
+    FILE* file = nullptr;
+    bool binary = false;
+    bool eof = false;
+    std::vector<char> buffer;
+    size_t pos = 0;
+    size_t len = 0;
+    std::string error_message;
+};
+
+bool write_binary_trace(const std::string& path, const uint32_t* words, size_t count);
+bool write_text_trace(const std::string& path, const uint32_t* words, size_t count);
+
+#endif
@@ -0,0 +1,46 @@
+#include <iostream>
+#include <string>
+
+#include "trace_loader.h"
+
+using namespace std;
+
+// Convert between hex text traces and the binary trace format. The input
+// format is detected from the file; the output is the other format unless
+// --text or --binary is given.
+int main(int argc, char* argv[]) {
+    string format;
+    string paths[2];
+    int npaths = 0;
+    for (int a = 1; a < argc; ++a) {
+        string arg = argv[a];
+        if (arg == "--text" || arg == "--binary") {
+            format = arg.substr(2);
+        } else if (npaths < 2) {
+            paths[npaths++] = arg;
+        } else {
+            npaths = 3;
+        }
+    }
+    if (npaths != 2) {
+        cerr << "Usage: traceconv [--text|--binary] <input_file> <output_file>" << endl;
+        return 1;
+    }
+
+    TraceFile trace;
+    if (!trace.open(paths[0])) {
+        cerr << trace.error() << endl;
+        return 1;
+    }
+    if (format.empty()) {
+        format = trace.is_binary() ? "text" : "binary";
+    }
+
+    bool ok = format == "binary" ? write_binary_trace(paths[1], trace.data(), trace.size())
+                                 : write_text_trace(paths[1], trace.data(), trace.size());
+    if (!ok) {
+        cerr << "Error writing " << paths[1] << endl;
+        return 1;
+    }
+    return 0;
+}